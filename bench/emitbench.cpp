@@ -0,0 +1,91 @@
+// emitbench.cpp : measures IR emission throughput for different writer buffer sizes and sinks
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sourcefile.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "ASTNodes.h"
+#include "ir.h"
+#include "irwriter.h"
+
+#define helpstr "Usage: <emitbench> sourcefile [repetitions]\n"
+
+// emit the whole program reps times and report throughput in MB/s
+static void runCase(const char *label, CFG &prg, int reps, IRWriter &out, size_t bytesPerRep) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < reps; i++)
+        prg.outputIR(out);
+
+    out.flush();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double mb = (double) bytesPerRep * reps / (1024 * 1024);
+
+    printf("%-24s %10.3f s %12.1f MB/s\n", label, elapsed.count(), mb / elapsed.count());
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf(helpstr);
+        return 1;
+    }
+
+    int reps = argc > 2 ? atoi(argv[2]) : 2000;
+
+    std::unique_ptr<SourceFile> source;
+
+    try {
+        source = std::make_unique<SourceFile>(argv[1]);
+    } catch (const std::runtime_error &e) {
+        printf("%s\n", e.what());
+        return 1;
+    }
+
+    Tokenizer tok = Tokenizer(source->view());
+    Parser parser = Parser(tok);
+
+    auto AST = parser.parseProgram();
+    AST->typeCheck();
+    auto prgIR = AST->convertToIR();
+    prgIR->convertSSA();
+    prgIR->valueNumberingPass();
+
+    // size of one copy of the program text, used to compute throughput
+    std::string sizing;
+    {
+        auto out = IRWriter::toString(sizing);
+        prgIR->outputIR(out);
+    }
+
+    printf("%zu bytes of IR per repetition, %d repetitions\n", sizing.size(), reps);
+
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull < 0) {
+        printf("Could not open /dev/null\n");
+        return 1;
+    }
+
+    // a one byte buffer degenerates to a write(2) per token, like unbuffered per-token streaming
+    size_t capacities[] = {1, 256, 4096, 64 * 1024, IRWriter::defaultCapacity};
+
+    for (auto cap : capacities) {
+        IRWriter out(devnull, cap);
+        auto label = "fd, buffer " + std::to_string(cap);
+        runCase(label.c_str(), *prgIR, cap == 1 ? reps / 100 + 1 : reps, out, sizing.size());
+    }
+
+    std::string memory;
+    memory.reserve(sizing.size() * reps);
+    {
+        auto out = IRWriter::toString(memory);
+        runCase("string", *prgIR, reps, out, sizing.size());
+    }
+
+    close(devnull);
+    return 0;
+}
@@ -0,0 +1,242 @@
+// generator.cpp : builds synthetic programs of tunable size for compile-time benchmarks
+#include "generator.h"
+
+#include <random>
+#include <algorithm>
+
+namespace {
+
+// state for generating one method body
+struct MethodGen {
+    const GenConfig &cfg;
+    std::mt19937 &rng;
+    std::string &out;
+
+    int classIdx;
+    int methodIdx;
+    bool isMain;
+
+    int loopsLeft;
+    int callsLeft;
+
+    int pick(int n) {
+        return std::uniform_int_distribution<int>(0, n - 1)(rng);
+    }
+
+    bool chance(double p) {
+        return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+    }
+
+    void indent(int n) {
+        out.append(n, ' ');
+    }
+
+    // leaves read method arguments, int locals, constants and fields of this
+    void leaf() {
+        int choices = isMain ? 3 : 5 + (cfg.fields > 0);
+
+        switch (pick(choices)) {
+            case 0: out += std::to_string(pick(100)); break;
+            case 1: out += "v0"; break;
+            case 2: out += "v1"; break;
+            case 3: out += "a"; break;
+            case 4: out += "b"; break;
+            default: out += "&this.f" + std::to_string(pick(cfg.fields)); break;
+        }
+    }
+
+    void expr(int depth) {
+        if (depth == 0 || chance(0.35)) {
+            leaf();
+            return;
+        }
+
+        out += '(';
+
+        switch (pick(4)) {
+            case 0: expr(depth - 1); out += " + "; expr(depth - 1); break;
+            case 1: expr(depth - 1); out += " - "; expr(depth - 1); break;
+            case 2: expr(depth - 1); out += " * "; out += std::to_string(pick(9) + 1); break;
+
+            // only constant divisors, so generated programs never divide by zero
+            default: expr(depth - 1); out += " / "; out += std::to_string(pick(9) + 1); break;
+        }
+
+        out += ')';
+    }
+
+    // calls only go to lower classes or lower methods of this class, so there is no recursion
+    bool call(int ind) {
+        bool lowerClass = classIdx > 0;
+        bool lowerMethod = methodIdx > 0;
+
+        if (isMain || (!lowerClass && !lowerMethod))
+            return false;
+
+        indent(ind);
+        out += "v" + std::to_string(pick(2)) + " = ^";
+
+        if (lowerClass && (!lowerMethod || chance(0.5)))
+            out += "o.m" + std::to_string(pick(cfg.methods));
+        else
+            out += "this.m" + std::to_string(pick(methodIdx));
+
+        out += '(';
+        expr(1);
+        out += ", ";
+        expr(1);
+        out += ")\n";
+
+        callsLeft--;
+        return true;
+    }
+
+    void block(int ind, int count, int depthLeft, int loopDepth) {
+        for (int i = 0; i < count; i++) {
+            int remaining = count - i;
+
+            // loops are forced into the last slots of the top level block so every method gets its share
+            bool wantLoop = loopsLeft > 0 && depthLeft > 0 && loopDepth < 3 &&
+                (chance(0.2) || (loopDepth == 0 && remaining <= loopsLeft));
+
+            if (wantLoop) {
+                whileStmt(ind, count, depthLeft, loopDepth);
+                continue;
+            }
+
+            if (depthLeft > 0 && chance(0.15)) {
+                ifStmt(ind, count, depthLeft, loopDepth);
+                continue;
+            }
+
+            if (callsLeft > 0 && (loopDepth == 0 || cfg.loopCalls) && chance(0.3) && call(ind))
+                continue;
+
+            if (cfg.loopCalls && loopDepth > 0 && !isMain && classIdx > 0 && chance(0.15)) {
+                indent(ind);
+                out += "o = @C" + std::to_string(classIdx - 1) + '\n';
+                continue;
+            }
+
+            if (!isMain && cfg.fields > 0 && chance(0.15)) {
+                indent(ind);
+                out += "!this.f" + std::to_string(pick(cfg.fields)) + " = ";
+                expr(2);
+                out += '\n';
+                continue;
+            }
+
+            indent(ind);
+
+            if (chance(0.05)) {
+                out += "print(";
+                expr(2);
+                out += ")\n";
+                continue;
+            }
+
+            out += "v" + std::to_string(pick(2)) + " = ";
+            expr(3);
+            out += '\n';
+        }
+    }
+
+    void whileStmt(int ind, int count, int depthLeft, int loopDepth) {
+        auto counter = "c" + std::to_string(loopDepth);
+        loopsLeft--;
+
+        indent(ind);
+        out += counter + " = " + std::to_string(pick(5) + 2) + '\n';
+
+        indent(ind);
+        out += "while (" + counter + " > 0): {\n";
+        block(ind + 4, std::max(1, count / 4), depthLeft - 1, loopDepth + 1);
+
+        indent(ind + 4);
+        out += counter + " = (" + counter + " - 1)\n";
+
+        indent(ind);
+        out += "}\n";
+    }
+
+    void ifStmt(int ind, int count, int depthLeft, int loopDepth) {
+        bool ifonly = chance(0.4);
+
+        indent(ind);
+        out += ifonly ? "ifonly (" : "if (";
+        expr(1);
+        out += pick(2) ? " > " : " < ";
+        expr(1);
+        out += "): {\n";
+
+        block(ind + 4, std::max(1, count / 4), depthLeft - 1, loopDepth);
+
+        if (!ifonly) {
+            indent(ind);
+            out += "} else {\n";
+            block(ind + 4, std::max(1, count / 4), depthLeft - 1, loopDepth);
+        }
+
+        indent(ind);
+        out += "}\n";
+    }
+};
+
+}
+
+std::string generateProgram(const GenConfig &cfg) {
+    std::mt19937 rng(cfg.seed);
+    std::string out;
+
+    for (int c = 0; c < cfg.classes; c++) {
+        out += "class C" + std::to_string(c) + " [\n";
+        out += "    fields";
+
+        for (int f = 0; f < cfg.fields; f++)
+            out += (f ? ", f" : " f") + std::to_string(f) + ":int";
+
+        out += '\n';
+
+        for (int m = 0; m < cfg.methods; m++) {
+            out += "    method m" + std::to_string(m) + "(a:int, b:int) returning int with locals v0:int, v1:int, c0:int, c1:int, c2:int";
+
+            if (c > 0)
+                out += ", o:C" + std::to_string(c - 1);
+
+            out += ":\n";
+
+            MethodGen gen{cfg, rng, out, c, m, false, cfg.loops, cfg.calls};
+
+            out += "        v0 = a\n";
+            out += "        v1 = b\n";
+
+            if (c > 0)
+                out += "        o = @C" + std::to_string(c - 1) + '\n';
+
+            gen.block(8, cfg.stmts, cfg.depth, 0);
+            out += "        return (v0 + v1)\n";
+        }
+
+        out += "]\n\n";
+    }
+
+    // main drives the top method of the top class
+    out += "main with v0:int, v1:int, c0:int, c1:int, c2:int";
+
+    if (cfg.classes > 0)
+        out += ", o:C" + std::to_string(cfg.classes - 1);
+
+    out += ":\n";
+
+    MethodGen gen{cfg, rng, out, 0, 0, true, cfg.loops, 0};
+    gen.block(4, std::max(1, cfg.stmts / 4), cfg.depth, 0);
+
+    if (cfg.classes > 0 && cfg.methods > 0) {
+        out += "    o = @C" + std::to_string(cfg.classes - 1) + '\n';
+        out += "    v0 = ^o.m" + std::to_string(cfg.methods - 1) + "(v0, v1)\n";
+    }
+
+    out += "    print(v0)\n";
+
+    return out;
+}
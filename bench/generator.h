@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+// Shape of a synthetic program
+// Every class gets the same method names so vtables are as wide as the method count
+struct GenConfig {
+    int classes = 4;
+    int methods = 4;
+    int fields = 4;
+
+    // how deeply if/ifonly/while statements nest inside each other
+    int depth = 2;
+
+    // while loops per method, each counting a local down from a small constant
+    int loops = 2;
+
+    // statements in every method body, nested blocks get a quarter of their parent's count
+    int stmts = 16;
+
+    // calls per method into lower classes or lower methods, kept out of loops so runtime stays linear
+    int calls = 1;
+
+    // lets calls into loops, along with allocations, so the collector runs while loops hold addresses into this
+    // runtime then multiplies with the trip counts of every loop on the way down the call chain
+    bool loopCalls = false;
+
+    unsigned seed = 1;
+};
+
+// build the source of a valid, type correct and terminating program
+std::string generateProgram(const GenConfig &cfg);
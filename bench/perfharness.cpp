@@ -0,0 +1,402 @@
+// perfharness.cpp : checks ir441 execution counters of compiled programs against a checked-in baseline
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "generator.h"
+
+#define helpstr "Usage: <perfharness> --comp=path --ir441=path --baseline=file [--threshold=fraction] [--generated=N] [--update] {corpusdir | sourcefile}...\n"
+
+namespace fs = std::filesystem;
+
+// counter name -> value, as printed by ir441 perf
+using Counters = std::map<std::string, long>;
+
+// program -> variant -> counters
+using Results = std::map<std::string, std::map<std::string, Counters>>;
+
+struct Variant {
+    const char *name;
+    const char *flag;
+};
+
+static const Variant variants[] = {
+    {"full", ""},
+    {"O2", "-O2"},
+    {"O3", "-O3"},
+    {"noVN", "-noVN"},
+    {"noSSA", "-noSSA"},
+};
+
+static std::string quote(const std::string &s) {
+    std::string q = "'";
+
+    for (char c : s) {
+        if (c == '\'')
+            q += "'\\''";
+        else
+            q += c;
+    }
+
+    return q + "'";
+}
+
+// run a shell command, returning its exit status and everything it wrote
+static int run(const std::string &cmd, std::string &output) {
+    FILE *p = popen((cmd + " 2>&1").c_str(), "r");
+    if (!p)
+        throw std::runtime_error("Could not run '" + cmd + "'");
+
+    char buf[4096];
+    size_t n;
+
+    output.clear();
+    while ((n = fread(buf, 1, sizeof(buf), p)) > 0)
+        output.append(buf, n);
+
+    return pclose(p);
+}
+
+// what the program printed, up to its final result, ir441 lists the parsed IR and two blank lines before it
+static std::string programOutput(const std::string &output) {
+    auto start = output.find("\n\n\n");
+    return start == std::string::npos ? output : output.substr(start + 3);
+}
+
+// pull the counters out of "ExecStats { fast_alu_ops: 1, slow_alu_ops: 2, ... }"
+static bool parseExecStats(const std::string &output, Counters &counters) {
+    auto start = output.rfind("ExecStats {");
+    if (start == std::string::npos)
+        return false;
+
+    auto end = output.find('}', start);
+    std::istringstream in(output.substr(start + 11, end - start - 11));
+    std::string field;
+
+    while (in >> field) {
+        long value;
+        if (field.back() != ':' || !(in >> value))
+            return false;
+
+        field.pop_back();
+        counters[field] = value;
+
+        // skip the comma after every value but the last
+        if (in.peek() == ',')
+            in.get();
+    }
+
+    return !counters.empty();
+}
+
+// minimal reader for the three level object of integers the baseline is written as
+class BaselineReader {
+    std::string text;
+    size_t pos = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && isspace((unsigned char) text[pos]))
+            pos++;
+    }
+
+    void expect(char c) {
+        skipSpace();
+        if (pos >= text.size() || text[pos] != c)
+            throw std::runtime_error(std::string("Malformed baseline, expected '") + c + "' at offset " + std::to_string(pos));
+        pos++;
+    }
+
+    bool next(char c) {
+        skipSpace();
+        if (pos < text.size() && text[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    std::string key() {
+        expect('"');
+        auto end = text.find('"', pos);
+        if (end == std::string::npos)
+            throw std::runtime_error("Malformed baseline, unterminated string");
+
+        auto s = text.substr(pos, end - pos);
+        pos = end + 1;
+        expect(':');
+        return s;
+    }
+
+    // calls member for every key of an object
+    template <typename F>
+    void object(F member) {
+        expect('{');
+        if (next('}'))
+            return;
+
+        do {
+            member(key());
+        } while (next(','));
+
+        expect('}');
+    }
+
+public:
+    explicit BaselineReader(std::string t): text(std::move(t)) {}
+
+    Results read() {
+        Results results;
+
+        object([&](std::string program) {
+            object([&](std::string variant) {
+                object([&](std::string counter) {
+                    skipSpace();
+                    char *end;
+                    long v = strtol(text.c_str() + pos, &end, 10);
+                    if (end == text.c_str() + pos)
+                        throw std::runtime_error("Malformed baseline, expected a number at offset " + std::to_string(pos));
+
+                    pos = end - text.c_str();
+                    results[program][variant][counter] = v;
+                });
+            });
+        });
+
+        return results;
+    }
+};
+
+static Results readBaseline(const std::string &path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        return {};
+
+    std::stringstream buf;
+    buf << in.rdbuf();
+    return BaselineReader(buf.str()).read();
+}
+
+static void writeBaseline(const std::string &path, const Results &results) {
+    std::ofstream out(path);
+    if (!out.is_open())
+        throw std::runtime_error("Could not write baseline '" + path + "'");
+
+    out << "{\n";
+
+    size_t p = 0;
+    for (auto &[program, byVariant] : results) {
+        out << "  \"" << program << "\": {\n";
+
+        size_t v = 0;
+        for (auto &[variant, counters] : byVariant) {
+            out << "    \"" << variant << "\": {";
+
+            size_t c = 0;
+            for (auto &[counter, value] : counters)
+                out << (c++ ? ", " : "") << '"' << counter << "\": " << value;
+
+            out << (++v < byVariant.size() ? "},\n" : "}\n");
+        }
+
+        out << (++p < results.size() ? "  },\n" : "  }\n");
+    }
+
+    out << "}\n";
+}
+
+int main(int argc, char **argv) {
+    std::string comp, ir441, baselinePath;
+    double threshold = 0.0;
+    int generated = 0;
+    bool update = false;
+    std::vector<std::string> corpus;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--comp=", 7) == 0)
+            comp = argv[i] + 7;
+        else if (strncmp(argv[i], "--ir441=", 8) == 0)
+            ir441 = argv[i] + 8;
+        else if (strncmp(argv[i], "--baseline=", 11) == 0)
+            baselinePath = argv[i] + 11;
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+            threshold = atof(argv[i] + 12);
+        else if (strncmp(argv[i], "--generated=", 12) == 0)
+            generated = atoi(argv[i] + 12);
+        else if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else if (argv[i][0] == '-') {
+            printf(helpstr);
+            return strcmp(argv[i], "-help") == 0 ? 0 : 1;
+        }
+        else
+            corpus.push_back(argv[i]);
+    }
+
+    if (comp.empty() || ir441.empty() || baselinePath.empty()) {
+        printf(helpstr);
+        return 1;
+    }
+
+    // program name -> source path, directories contribute every .prg file inside them
+    std::map<std::string, std::string> programs;
+
+    for (auto &entry : corpus) {
+        if (fs::is_directory(entry)) {
+            for (auto &file : fs::directory_iterator(entry))
+                if (file.path().extension() == ".prg")
+                    programs[file.path().filename().string()] = file.path().string();
+        }
+        else
+            programs[fs::path(entry).filename().string()] = entry;
+    }
+
+    auto work = fs::temp_directory_path() / ("perfharness-" + std::to_string(getpid()));
+    fs::create_directories(work);
+
+    // generated programs widen coverage beyond the hand written corpus, fixed seeds keep them stable
+    for (int seed = 1; seed <= generated; seed++) {
+        GenConfig cfg;
+        cfg.seed = seed;
+
+        auto name = "generated-" + std::to_string(seed) + ".prg";
+        auto path = (work / name).string();
+
+        std::ofstream(path) << generateProgram(cfg);
+        programs[name] = path;
+
+        // the same with calls and allocations inside loops, where an address kept across one goes stale
+        cfg.loopCalls = true;
+        name = "generated-loopcalls-" + std::to_string(seed) + ".prg";
+        path = (work / name).string();
+
+        std::ofstream(path) << generateProgram(cfg);
+        programs[name] = path;
+    }
+
+    Results baseline;
+    Results current;
+    int failures = 0;
+
+    try {
+        baseline = readBaseline(baselinePath);
+    } catch (const std::runtime_error &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    for (auto &[name, source] : programs) {
+        std::string output;
+
+        // the program has to run to completion under the collector with its gc maps in place
+        auto gcIR = (work / (name + ".full.gc.ir")).string();
+        if (run(quote(comp) + " -o " + quote(gcIR) + " " + quote(source), output) != 0) {
+            if (baseline.contains(name)) {
+                printf("FAIL  %-24s no longer compiles\n", name.c_str());
+                failures++;
+            }
+            else
+                printf("skip  %-24s does not compile\n", name.c_str());
+
+            continue;
+        }
+
+        run(quote(ir441) + " exec-gc " + quote(gcIR), output);
+        if (output.find("Final result:") == std::string::npos) {
+            printf("FAIL  %-24s did not finish under exec-gc\n", name.c_str());
+            failures++;
+            continue;
+        }
+
+        auto expected = programOutput(output);
+
+        for (auto &variant : variants) {
+            // every optimized build has to as well, and print what the full build prints
+            if (*variant.flag) {
+                auto gcVariant = (work / (name + '.' + variant.name + ".gc.ir")).string();
+
+                run(quote(comp) + " " + variant.flag + " -o " + quote(gcVariant) + " " + quote(source), output);
+                run(quote(ir441) + " exec-gc " + quote(gcVariant), output);
+
+                if (output.find("Final result:") == std::string::npos) {
+                    printf("FAIL  %-24s %-6s did not finish under exec-gc\n", name.c_str(), variant.name);
+                    failures++;
+                }
+                else if (programOutput(output) != expected) {
+                    printf("FAIL  %-24s %-6s prints something else under exec-gc\n", name.c_str(), variant.name);
+                    failures++;
+                }
+            }
+
+            // perf mode only counts, and has no room for gc maps in front of objects
+            auto ir = (work / (name + '.' + variant.name + ".ir")).string();
+            Counters counters;
+
+            run(quote(comp) + " -noGCMap " + variant.flag + " -o " + quote(ir) + " " + quote(source), output);
+            run(quote(ir441) + " perf " + quote(ir), output);
+
+            if (!parseExecStats(output, counters)) {
+                printf("FAIL  %-24s %-6s no ExecStats from ir441 perf\n", name.c_str(), variant.name);
+                failures++;
+                continue;
+            }
+
+            current[name][variant.name] = counters;
+
+            if (update)
+                continue;
+
+            if (!baseline.contains(name) || !baseline[name].contains(variant.name)) {
+                printf("new   %-24s %-6s not in baseline\n", name.c_str(), variant.name);
+                continue;
+            }
+
+            auto &base = baseline[name][variant.name];
+            bool regressed = false;
+            std::string changes;
+
+            for (auto &[counter, value] : counters) {
+                long was = base.contains(counter) ? base[counter] : 0;
+                if (value == was)
+                    continue;
+
+                changes += " " + counter + " " + std::to_string(was) + "->" + std::to_string(value);
+
+                if (value > was + was * threshold)
+                    regressed = true;
+            }
+
+            const char *status = regressed ? "FAIL" : changes.empty() ? "ok" : "diff";
+            printf("%-5s %-24s %-6s%s\n", status, name.c_str(), variant.name, changes.c_str());
+
+            if (regressed)
+                failures++;
+        }
+    }
+
+    fs::remove_all(work);
+
+    if (update) {
+        try {
+            writeBaseline(baselinePath, current);
+        } catch (const std::runtime_error &e) {
+            fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+
+        printf("wrote %zu programs to %s\n", current.size(), baselinePath.c_str());
+        return failures ? 1 : 0;
+    }
+
+    if (failures)
+        printf("%d regressions beyond a threshold of %g\n", failures, threshold);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+// phasebench.cpp : times every compiler phase separately on generated programs of growing size
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "generator.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "ASTNodes.h"
+#include "ir.h"
+#include "irwriter.h"
+
+#define helpstr "Usage: <phasebench> [--sweep=stmts|classes|methods|fields|depth|loops] [--min=N] [--max=N] [--reps=N] [--format=csv|json] [--seed=N]\n"
+
+static const char *phases[] = {"tokenize", "parse", "typecheck", "lower", "ssa", "vn", "emit"};
+static constexpr int phaseCount = sizeof(phases) / sizeof(phases[0]);
+
+struct Sample {
+    int size;
+    size_t sourceBytes;
+    size_t irBytes;
+    size_t blocks;
+    size_t instructions;
+    double seconds[phaseCount];
+};
+
+static double timeIt(const std::function<void()> &fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// run the whole pipeline once, with every phase timed on its own
+static void compileOnce(const std::string &src, Sample &s) {
+    double t[phaseCount];
+
+    t[0] = timeIt([&] {
+        Tokenizer tok(src);
+        while (tok.next().type != ENDOFFILE)
+            ;
+    });
+
+    ProgramPtr AST;
+    t[1] = timeIt([&] {
+        Parser parser = Parser(Tokenizer(src));
+        AST = parser.parseProgram();
+    });
+
+    t[2] = timeIt([&] { AST->typeCheck(); });
+
+    std::unique_ptr<CFG> prgIR;
+    t[3] = timeIt([&] { prgIR = AST->convertToIR(); });
+
+    t[4] = timeIt([&] { prgIR->convertSSA(); });
+    t[5] = timeIt([&] { prgIR->valueNumberingPass(); });
+
+    std::string ir;
+    t[6] = timeIt([&] {
+        auto out = IRWriter::toString(ir);
+        prgIR->outputIR(out);
+        out.flush();
+    });
+
+    s.sourceBytes = src.size();
+    s.irBytes = ir.size();
+    s.blocks = 0;
+    s.instructions = 0;
+
+    for (auto &[name, method] : prgIR->methodinfo)
+        for (auto &block : method->blocks) {
+            s.blocks++;
+            s.instructions += block->instructions.size();
+        }
+
+    // the fastest repetition is the least disturbed by the rest of the machine
+    for (int i = 0; i < phaseCount; i++)
+        if (t[i] < s.seconds[i])
+            s.seconds[i] = t[i];
+}
+
+static void printCSV(const char *sweep, const std::vector<Sample> &samples) {
+    printf("%s,source_bytes,ir_bytes,blocks,instructions", sweep);
+    for (auto phase : phases)
+        printf(",%s_us", phase);
+    printf("\n");
+
+    for (auto &s : samples) {
+        printf("%d,%zu,%zu,%zu,%zu", s.size, s.sourceBytes, s.irBytes, s.blocks, s.instructions);
+        for (int i = 0; i < phaseCount; i++)
+            printf(",%.1f", s.seconds[i] * 1e6);
+        printf("\n");
+    }
+}
+
+static void printJSON(const char *sweep, const std::vector<Sample> &samples) {
+    printf("{\"sweep\": \"%s\", \"samples\": [\n", sweep);
+
+    for (size_t n = 0; n < samples.size(); n++) {
+        auto &s = samples[n];
+        printf("  {\"size\": %d, \"source_bytes\": %zu, \"ir_bytes\": %zu, \"blocks\": %zu, \"instructions\": %zu, \"us\": {",
+            s.size, s.sourceBytes, s.irBytes, s.blocks, s.instructions);
+
+        for (int i = 0; i < phaseCount; i++)
+            printf("%s\"%s\": %.1f", i ? ", " : "", phases[i], s.seconds[i] * 1e6);
+
+        printf("}}%s\n", n + 1 < samples.size() ? "," : "");
+    }
+
+    printf("]}\n");
+}
+
+int main(int argc, char **argv) {
+    const char *sweep = "stmts";
+    const char *format = "csv";
+    int minSize = 0;
+    int maxSize = 0;
+    int reps = 5;
+
+    GenConfig cfg;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--sweep=", 8) == 0)
+            sweep = argv[i] + 8;
+        else if (strncmp(argv[i], "--format=", 9) == 0)
+            format = argv[i] + 9;
+        else if (strncmp(argv[i], "--min=", 6) == 0)
+            minSize = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "--max=", 6) == 0)
+            maxSize = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "--reps=", 7) == 0)
+            reps = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            cfg.seed = strtoul(argv[i] + 7, nullptr, 10);
+        else {
+            printf(helpstr);
+            return strcmp(argv[i], "-help") == 0 ? 0 : 1;
+        }
+    }
+
+    // the swept knob doubles from min to max, every other knob keeps its default
+    int *knob;
+    int defaultMin, defaultMax;
+
+    if (strcmp(sweep, "stmts") == 0)
+        knob = &cfg.stmts, defaultMin = 4, defaultMax = 128;
+    else if (strcmp(sweep, "classes") == 0)
+        knob = &cfg.classes, defaultMin = 1, defaultMax = 256;
+    else if (strcmp(sweep, "methods") == 0)
+        knob = &cfg.methods, defaultMin = 1, defaultMax = 256;
+    else if (strcmp(sweep, "fields") == 0)
+        knob = &cfg.fields, defaultMin = 1, defaultMax = 256;
+    else if (strcmp(sweep, "depth") == 0)
+        knob = &cfg.depth, defaultMin = 1, defaultMax = 8;
+    else if (strcmp(sweep, "loops") == 0)
+        knob = &cfg.loops, defaultMin = 1, defaultMax = 64;
+    else {
+        printf("Unknown sweep '%s'\n%s", sweep, helpstr);
+        return 1;
+    }
+
+    bool json = strcmp(format, "json") == 0;
+    if (!json && strcmp(format, "csv") != 0) {
+        printf("Unknown format '%s'\n%s", format, helpstr);
+        return 1;
+    }
+
+    if (minSize <= 0)
+        minSize = defaultMin;
+    if (maxSize <= 0)
+        maxSize = defaultMax;
+
+    std::vector<Sample> samples;
+
+    for (int size = minSize; size <= maxSize; size *= 2) {
+        *knob = size;
+        auto src = generateProgram(cfg);
+
+        Sample s;
+        s.size = size;
+        for (auto &t : s.seconds)
+            t = 1e30;
+
+        try {
+            for (int r = 0; r < reps; r++)
+                compileOnce(src, s);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "%s=%d: %s\n", sweep, size, e.what());
+            return 1;
+        }
+
+        samples.push_back(s);
+    }
+
+    if (json)
+        printJSON(sweep, samples);
+    else
+        printCSV(sweep, samples);
+
+    return 0;
+}
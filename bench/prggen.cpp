@@ -0,0 +1,55 @@
+// prggen.cpp : writes a synthetic program to stdout for compile-time experiments
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "generator.h"
+
+#define helpstr "Usage: <prggen> [--classes=N] [--methods=N] [--fields=N] [--depth=N] [--loops=N] [--stmts=N] [--calls=N] [--loop-calls] [--seed=N]\n"
+
+int main(int argc, char **argv) {
+    GenConfig cfg;
+
+    struct { const char *name; int *field; } knobs[] = {
+        {"--classes=", &cfg.classes},
+        {"--methods=", &cfg.methods},
+        {"--fields=", &cfg.fields},
+        {"--depth=", &cfg.depth},
+        {"--loops=", &cfg.loops},
+        {"--stmts=", &cfg.stmts},
+        {"--calls=", &cfg.calls},
+    };
+
+    for (int i = 1; i < argc; i++) {
+        bool matched = false;
+
+        for (auto &knob : knobs) {
+            auto len = strlen(knob.name);
+
+            if (strncmp(argv[i], knob.name, len) == 0) {
+                *knob.field = atoi(argv[i] + len);
+                matched = true;
+            }
+        }
+
+        if (strncmp(argv[i], "--seed=", 7) == 0) {
+            cfg.seed = strtoul(argv[i] + 7, nullptr, 10);
+            matched = true;
+        }
+
+        if (strcmp(argv[i], "--loop-calls") == 0) {
+            cfg.loopCalls = true;
+            matched = true;
+        }
+
+        if (!matched) {
+            printf(helpstr);
+            return strcmp(argv[i], "-help") == 0 ? 0 : 1;
+        }
+    }
+
+    auto src = generateProgram(cfg);
+    fwrite(src.data(), 1, src.size(), stdout);
+
+    return 0;
+}
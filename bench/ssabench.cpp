@@ -0,0 +1,498 @@
+// ssabench.cpp : compares incremental SSA and dominator maintenance with rebuilding them from scratch
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "generator.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "ASTNodes.h"
+#include "ir.h"
+#include "irwriter.h"
+#include "ssaupdater.h"
+
+#define helpstr "Usage: <ssabench> [--min=N] [--max=N] [--reps=N] [--seed=N] [--emit=file] [--check]\n"
+
+struct Sample {
+    int stmts;
+    size_t blocks = 0;
+    size_t criticalEdges = 0;
+    size_t variables = 0;
+    size_t ssaPhis = 0;
+    size_t updaterPhis = 0;
+
+    // full SSA construction, critical edge splitting with the dominator tree patched or recomputed after
+    // every split, and every variable's SSA form rebuilt by the updater
+    double ssa = 1e30;
+    double splitPatch = 1e30;
+    double splitRecompute = 1e30;
+    double rebuild = 1e30;
+};
+
+static double timeIt(const std::function<void()> &fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static std::unique_ptr<CFG> lower(const std::string &src) {
+    Parser parser = Parser(Tokenizer(src));
+    auto AST = parser.parseProgram();
+    AST->typeCheck();
+    return AST->convertToIR();
+}
+
+static size_t countPhis(CFG &cfg) {
+    size_t n = 0;
+
+    for (auto &[_, method] : cfg.methodinfo)
+        for (auto &block : method->blocks)
+            n += block->blockPhi.size();
+
+    return n;
+}
+
+// edges from a branch into a join
+static std::set<std::pair<BasicBlock *, BasicBlock *>> criticalEdges(MethodIR &method) {
+    method.requireAnalyses(Predecessors);
+
+    std::set<std::pair<BasicBlock *, BasicBlock *>> edges;
+
+    for (auto &block : method.blocks) {
+        auto succs = block->getNextBlocks();
+
+        if (succs.size() > 1 && succs[0] != succs[1])
+            for (auto succ : succs)
+                if (succ->predecessors.size() > 1)
+                    edges.insert({block.get(), succ});
+    }
+
+    return edges;
+}
+
+// splits every critical edge, the edits out-of-SSA translation makes
+static size_t splitCriticalEdges(MethodIR &method, bool patch) {
+    method.requireAnalyses(Predecessors | Dominators);
+
+    auto edges = criticalEdges(method);
+
+    for (auto [from, to] : edges) {
+        method.splitEdge(from, to);
+
+        // without patching, a pass that needs dominators after each edit has to recompute them
+        if (!patch) {
+            method.keepAnalyses(0);
+            method.requireAnalyses(Predecessors | Dominators);
+        }
+    }
+
+    method.requireAnalyses(DominanceFrontiers);
+    return edges.size();
+}
+
+static bool isVariable(const ValPtr &v, const std::string &name) {
+    auto lcl = dynamic_cast<Local *>(v.get());
+    return lcl && !lcl->ignoreSSA && lcl->name == name;
+}
+
+// rebuilds the SSA form of every variable with the updater, as if a transformation had just redefined it
+// each variable costs a scan of the method, so a transformation touching a few variables pays a fraction of this
+static size_t rebuildVariables(MethodIR &method, size_t &variables) {
+    std::set<std::string> vars;
+
+    for (auto &block : method.blocks) {
+        for (auto &phi : block->blockPhi)
+            vars.insert(phi->outputVar);
+
+        for (auto &inst : block->instructions)
+            if (auto res = inst->result(); res && isVariable(*res, (*res)->getString()))
+                vars.insert((*res)->getString());
+    }
+
+    size_t phis = 0;
+    variables += vars.size();
+
+    for (auto &var : vars) {
+        for (auto &block : method.blocks)
+            std::erase_if(block->blockPhi, [&](const std::unique_ptr<Phi> &phi) { return phi->outputVar == var; });
+
+        SSAUpdater updater(method, var);
+
+        for (auto &block : method.blocks) {
+            ValPtr last;
+
+            for (auto &inst : block->instructions)
+                if (auto res = inst->result(); res && isVariable(*res, var))
+                    last = *res;
+
+            if (last)
+                updater.addDefinition(block.get(), last);
+        }
+
+        for (auto &block : method.blocks) {
+            ValPtr current;
+
+            auto use = [&](ValPtr *slot) {
+                if (!isVariable(*slot, var))
+                    return;
+
+                if (current)
+                    *slot = current;
+                else
+                    updater.rewriteUse(slot, block.get());
+            };
+
+            for (auto &inst : block->instructions) {
+                for (auto slot : inst->operands())
+                    use(slot);
+
+                if (auto res = inst->result(); res && isVariable(*res, var))
+                    current = *res;
+            }
+
+            for (auto slot : block->blockTransfer->operands())
+                use(slot);
+        }
+
+        phis += updater.phisPlaced();
+    }
+
+    method.keepAnalyses(CFGAnalyses);
+    return phis;
+}
+
+// predecessors, immediate dominator and dominator tree children of every block
+using CFGShape = std::map<BasicBlock *, std::tuple<std::set<BasicBlock *>, BasicBlock *, std::set<BasicBlock *>>>;
+
+static CFGShape shape(MethodIR &method) {
+    CFGShape s;
+
+    for (auto &block : method.blocks)
+        s[block.get()] = {block->predecessors, block->immediateDominator,
+            std::set<BasicBlock *>(block->domChildren.begin(), block->domChildren.end())};
+
+    return s;
+}
+
+// the analyses an edit patched against the ones computed from scratch, children compared regardless of order
+static bool matchesRecomputed(MethodIR &method, const char *edit) {
+    auto patched = shape(method);
+
+    method.keepAnalyses(0);
+    method.requireAnalyses(Predecessors | Dominators);
+
+    if (patched == shape(method))
+        return true;
+
+    fprintf(stderr, "%s: %s left predecessors or dominators that differ from recomputed ones\n", method.getName().c_str(), edit);
+    return false;
+}
+
+struct CheckCounts {
+    size_t methods = 0;
+    size_t edits = 0;
+    size_t uses = 0;
+    size_t failures = 0;
+};
+
+// every CFG edit with patched analyses, each followed by a recompute to compare with: critical edges are split,
+// joins with three or more ways in get all but one moved behind a new block, and the empty blocks splitting made
+// are hoisted back into their predecessor
+static void checkCFGEdits(MethodIR &method, CheckCounts &counts) {
+    method.requireAnalyses(Predecessors | Dominators);
+
+    std::vector<BasicBlock *> splits;
+
+    for (auto [from, to] : criticalEdges(method)) {
+        splits.push_back(method.splitEdge(from, to));
+        counts.edits++;
+        counts.failures += !matchesRecomputed(method, "splitEdge");
+    }
+
+    std::vector<BasicBlock *> joins;
+    for (auto &block : method.blocks)
+        if (block->predecessors.size() > 2)
+            joins.push_back(block.get());
+
+    for (auto join : joins) {
+        std::vector<BasicBlock *> preds(join->predecessors.begin(), join->predecessors.end());
+        std::sort(preds.begin(), preds.end(), [](BasicBlock *a, BasicBlock *b) { return a->label < b->label; });
+
+        method.splitPredecessors(join, std::vector<BasicBlock *>(preds.begin() + 1, preds.end()));
+        counts.edits++;
+        counts.failures += !matchesRecomputed(method, "splitPredecessors");
+    }
+
+    for (auto split : splits) {
+        auto pred = *split->predecessors.begin();
+        auto succ = split->getNextBlocks()[0];
+        auto others = pred->getNextBlocks();
+
+        // phis merging differing arguments, or a predecessor reaching the same block another way, have to stay
+        if (!split->blockPhi.empty() || std::count(others.begin(), others.end(), succ))
+            continue;
+
+        method.hoistIntoPredecessor(split);
+        counts.edits++;
+        counts.failures += !matchesRecomputed(method, "hoistIntoPredecessor");
+    }
+}
+
+static std::string describe(const ValPtr &v) {
+    auto lcl = dynamic_cast<Local *>(v.get());
+    return lcl ? valueKey(*lcl) : v->getString();
+}
+
+// every variable rebuilt by the updater against the SSA form convertSSA gave it, use by use and phi by phi
+// convertSSA keeps phis that merge a single value, which stand for that value here, the updater folds them
+static void checkUpdater(MethodIR &method, CheckCounts &counts) {
+    std::map<ValPtr *, ValPtr> before;
+    std::map<std::pair<BasicBlock *, std::string>, std::string> phiAt;
+    std::map<std::string, std::vector<std::pair<std::string, ValPtr>>> phiArgs;
+
+    for (auto &block : method.blocks) {
+        for (auto &phi : block->blockPhi) {
+            auto key = valueKey(Local(phi->outputVar, phi->resultVersion));
+            phiAt[{block.get(), phi->outputVar}] = key;
+            phiArgs[key] = phi->incoming;
+        }
+
+        for (auto &inst : block->instructions)
+            for (auto slot : inst->operands())
+                before[slot] = *slot;
+
+        for (auto slot : block->blockTransfer->operands())
+            before[slot] = *slot;
+    }
+
+    std::map<std::string, ValPtr> folded;
+
+    auto resolve = [&](ValPtr v) {
+        for (auto lcl = dynamic_cast<Local *>(v.get()); lcl && folded.contains(valueKey(*lcl)); lcl = dynamic_cast<Local *>(v.get()))
+            v = folded.at(valueKey(*lcl));
+
+        return v;
+    };
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (auto &[key, args] : phiArgs) {
+            if (folded.contains(key))
+                continue;
+
+            std::set<std::string> distinct;
+            ValPtr only;
+
+            for (auto &[_, val] : args) {
+                auto v = resolve(val);
+
+                if (describe(v) != key && distinct.insert(describe(v)).second)
+                    only = v;
+            }
+
+            if (distinct.size() == 1) {
+                folded[key] = only;
+                changed = true;
+            }
+        }
+    }
+
+    size_t variables = 0;
+    rebuildVariables(method, variables);
+
+    std::map<std::string, std::pair<BasicBlock *, Phi *>> newPhis;
+    for (auto &block : method.blocks)
+        for (auto &phi : block->blockPhi)
+            newPhis[valueKey(Local(phi->outputVar, phi->resultVersion))] = {block.get(), phi.get()};
+
+    // the updater's phis go by the block and variable convertSSA placed them for
+    auto rename = [&](const ValPtr &v) {
+        auto it = newPhis.find(describe(v));
+
+        if (it == newPhis.end())
+            return describe(v);
+
+        auto old = phiAt.find({it->second.first, it->second.second->outputVar});
+        return old == phiAt.end() ? "no phi from convertSSA for " + describe(v) : old->second;
+    };
+
+    bool ok = true;
+
+    auto compare = [&](const ValPtr &was, const ValPtr &now, const std::string &where) {
+        auto expected = describe(resolve(was));
+        auto actual = rename(now);
+
+        if (expected != actual && ok) {
+            fprintf(stderr, "%s: %s reads %s after the updater, %s after convertSSA\n", method.getName().c_str(),
+                where.c_str(), actual.c_str(), expected.c_str());
+            ok = false;
+        }
+    };
+
+    for (auto &[slot, was] : before) {
+        counts.uses++;
+        compare(was, *slot, "a use");
+    }
+
+    for (auto &[key, placed] : newPhis) {
+        auto [block, phi] = placed;
+        auto old = phiAt.find({block, phi->outputVar});
+
+        if (old == phiAt.end())
+            continue;
+
+        for (auto &[label, val] : phi->incoming) {
+            auto &args = phiArgs[old->second];
+            auto in = std::find_if(args.begin(), args.end(), [&](auto &a) { return a.first == label; });
+
+            if (in != args.end())
+                compare(in->second, val, "the phi for " + phi->outputVar + " in " + block->label);
+        }
+    }
+
+    counts.failures += !ok;
+}
+
+static void runOnce(const std::string &src, Sample &s, const char *emit) {
+    auto cfg = lower(src);
+
+    s.ssa = std::min(s.ssa, timeIt([&] { cfg->convertSSA(); }));
+    s.ssaPhis = countPhis(*cfg);
+
+    s.splitPatch = std::min(s.splitPatch, timeIt([&] {
+        s.criticalEdges = 0;
+        for (auto &[_, method] : cfg->methodinfo)
+            s.criticalEdges += splitCriticalEdges(*method, true);
+    }));
+
+    s.rebuild = std::min(s.rebuild, timeIt([&] {
+        s.updaterPhis = 0;
+        s.variables = 0;
+        for (auto &[_, method] : cfg->methodinfo)
+            s.updaterPhis += rebuildVariables(*method, s.variables);
+    }));
+
+    s.blocks = 0;
+    for (auto &[_, method] : cfg->methodinfo)
+        s.blocks += method->blocks.size();
+
+    if (emit) {
+        std::string ir;
+        auto out = IRWriter::toString(ir);
+        cfg->outputIR(out);
+        out.flush();
+        std::ofstream(emit) << ir;
+    }
+
+    auto again = lower(src);
+    again->convertSSA();
+
+    s.splitRecompute = std::min(s.splitRecompute, timeIt([&] {
+        for (auto &[_, method] : again->methodinfo)
+            splitCriticalEdges(*method, false);
+    }));
+}
+
+// runs both checks on fresh SSA form of every method, for reps seeds at each size
+static int runChecks(GenConfig cfg, int minSize, int maxSize, int reps) {
+    CheckCounts counts;
+    auto firstSeed = cfg.seed;
+
+    for (int size = minSize; size <= maxSize; size *= 2) {
+        cfg.stmts = size;
+
+        for (int r = 0; r < reps; r++) {
+            cfg.seed = firstSeed + r;
+            auto src = generateProgram(cfg);
+
+            try {
+                auto edited = lower(src);
+                edited->convertSSA();
+
+                for (auto &[_, method] : edited->methodinfo) {
+                    counts.methods++;
+                    checkCFGEdits(*method, counts);
+                }
+
+                auto rebuilt = lower(src);
+                rebuilt->convertSSA();
+
+                for (auto &[_, method] : rebuilt->methodinfo)
+                    checkUpdater(*method, counts);
+            } catch (const std::exception &e) {
+                fprintf(stderr, "stmts=%d seed=%lu: %s\n", size, (unsigned long) cfg.seed, e.what());
+                return 1;
+            }
+        }
+    }
+
+    printf("checked %zu methods: %zu CFG edits against recomputed dominators, %zu uses against convertSSA, %zu failures\n",
+        counts.methods, counts.edits, counts.uses, counts.failures);
+
+    return counts.failures ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    int minSize = 4;
+    int maxSize = 128;
+    int reps = 5;
+    const char *emit = nullptr;
+    bool check = false;
+
+    GenConfig cfg;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--min=", 6) == 0)
+            minSize = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "--max=", 6) == 0)
+            maxSize = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "--reps=", 7) == 0)
+            reps = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+            cfg.seed = strtoul(argv[i] + 7, nullptr, 10);
+        else if (strncmp(argv[i], "--emit=", 7) == 0)
+            emit = argv[i] + 7;
+        else if (strcmp(argv[i], "--check") == 0)
+            check = true;
+        else {
+            printf(helpstr);
+            return strcmp(argv[i], "-help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (check)
+        return runChecks(cfg, minSize, maxSize, reps);
+
+    printf("stmts,blocks,critical_edges,variables,ssa_phis,updater_phis,ssa_us,split_patch_us,split_recompute_us,rebuild_us,rebuild_per_var_us\n");
+
+    // statement count doubles from min to max, the largest program is the one emitted
+    for (int size = minSize; size <= maxSize; size *= 2) {
+        cfg.stmts = size;
+        auto src = generateProgram(cfg);
+
+        Sample s;
+        s.stmts = size;
+
+        try {
+            for (int r = 0; r < reps; r++)
+                runOnce(src, s, size * 2 > maxSize ? emit : nullptr);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "stmts=%d: %s\n", size, e.what());
+            return 1;
+        }
+
+        printf("%d,%zu,%zu,%zu,%zu,%zu,%.1f,%.1f,%.1f,%.1f,%.1f\n", s.stmts, s.blocks, s.criticalEdges, s.variables,
+            s.ssaPhis, s.updaterPhis, s.ssa * 1e6, s.splitPatch * 1e6, s.splitRecompute * 1e6, s.rebuild * 1e6,
+            s.rebuild * 1e6 / std::max<size_t>(s.variables, 1));
+    }
+
+    return 0;
+}
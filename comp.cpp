@@ -1,67 +1,199 @@
 #include <stdio.h>
 #include <string.h>
-#include <sstream>
-#include <fstream>
+#include <iostream>
 
-#include "tokenizer.h"
-#include "parser.h"
-#include "ASTNodes.h"
-#include "ir.h"
+#include "sourcefile.h"
+#include "driver.h"
+#include "server.h"
+#include "batch.h"
+#include "irwriter.h"
+#include "ircache.h"
 
-#define helpstr "Usage: <comp> {-help | -printAST | -noopt | -noSSA | -noVN} sourcefile\n"
+#define helpstr "Usage: <comp> {-help | -printAST | -noopt | -noSSA | -noVN} [-O0|-O1|-O2|-O3] [-passes=list] [-budget=spec] [-stream] [-noGCMap] [-noPhis] [-cache=dir] [-time-passes] [-stats] [-trace-out=file] [-o outfile] sourcefile\n" \
+    "       <comp> [options] [-j threads] [-o outdir] {-manifest=file | sourcefile...}\n" \
+    "       <comp> --serve[=socketpath] [-j threads] [-cache=dir]\n" \
+    "(sourcefile may be - to read from stdin)\n"
 
 int main(int argc, char **argv) {
-    if (argc < 2 || argc > 4) {
+    if (argc < 2) {
         std::cout << helpstr;
         return 1;
     }
 
-    if (strcmp(argv[1], "-help") == 0) {
+    const char *outfile = nullptr;
+    const char *cachedir = nullptr;
+    const char *manifest = nullptr;
+    const char *traceOut = nullptr;
+    bool timePasses = false;
+    bool printStats = false;
+    std::vector<std::string> filenames;
+    bool help = false;
+    bool threadsGiven = false;
+
+    CompileOptions opts;
+
+    bool serve = false;
+    ServerOptions sopts;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "-j") == 0) {
+            if (i + 1 == argc) {
+                std::cout << helpstr;
+                return 1;
+            }
+
+            if (argv[i][1] == 'o')
+                outfile = argv[++i];
+            else {
+                sopts.threads = atoi(argv[++i]);
+                threadsGiven = true;
+            }
+        }
+        else if (strcmp(argv[i], "-help") == 0)
+            help = true;
+        else if (strcmp(argv[i], "--serve") == 0)
+            serve = true;
+        else if (strncmp(argv[i], "--serve=", 8) == 0) {
+            serve = true;
+            sopts.socketPath = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "-cache=", 7) == 0)
+            cachedir = argv[i] + 7;
+        else if (strncmp(argv[i], "-manifest=", 10) == 0)
+            manifest = argv[i] + 10;
+        else if (strcmp(argv[i], "-time-passes") == 0)
+            timePasses = true;
+        else if (strcmp(argv[i], "-stats") == 0)
+            printStats = true;
+        else if (strncmp(argv[i], "-trace-out=", 11) == 0)
+            traceOut = argv[i] + 11;
+        else if (applyCompileFlag(argv[i], opts))
+            continue;
+        else if (argv[i][0] == '-' && argv[i][1]) {
+            std::cout << "Unknown option '" << argv[i] << "'\n" << helpstr;
+            return 1;
+        }
+        else
+            filenames.push_back(argv[i]);
+    }
+
+    if (help) {
         std::cout << helpstr;
-        printf("Please provide one or no arguments. -help shows this menu.\n-printAST, -noSSA, -noopt, -noSSA, and -noVN stop the compiler after the corresponding pass and print results.");
+        printf("Please provide one or no arguments. -help shows this menu.\n-printAST, -noSSA, -noopt, -noSSA, and -noVN stop the compiler after the corresponding pass and print results.\n-O0 to -O3 pick a preset pipeline (-O1 is the default), and -passes= runs a comma separated list of the passes below instead.\n-budget=blocks:N,insts:N,vars:N sets the per-method soft limits (default blocks:500,insts:10000,vars:5000). Past them pruned-ssa falls back to ssa and gvn to vn, and past four times them SSA is not built. -budget=none disables the limits. unroll:N and factor:N set how many instructions unrolling may add per loop and how many copies a loop it cannot unroll completely gets, and unswitch:N how many instructions unswitching may add per method (default unroll:64,factor:4,unswitch:64).\n-o writes IR to the given file instead of stdout.\n-stream lowers, optimizes and emits one method at a time, releasing each before the next.\n-noGCMap leaves out the gc map stored in front of every allocation, which ir441's perf and trace modes do not reserve room for.\n-noPhis ends a pipeline that builds SSA with out-of-ssa, which turns phis into copies and reports how many it removed under -stats.\n-cache=dir keeps each method's optimized IR in dir and reuses it while the method and the layouts it depends on are unchanged.\n-time-passes reports wall time, cpu time and peak RSS of every phase on stderr.\n-stats reports counts of blocks, instructions, phis, value numbering replacements and temporaries on stderr.\n-trace-out=file writes a chrome trace with a span for every phase of every method.\n--serve answers length-prefixed compile requests on stdin, or on a unix socket when a path is given, using -j worker threads.\nGiven several source files or a -manifest listing them, files are compiled on -j threads and each file's IR goes next to it (or into the -o directory) with a .ir extension.\n");
+
+        printf("\nPasses:\n");
+        for (auto &pass : registeredPasses())
+            printf("  %-12s %s\n", pass.name, pass.description);
+
+        for (int level = 0; level <= 3; level++)
+            printf("-O%d = '%s'\n", level, PassManager::preset(level).c_str());
+
         return 0;
     }
 
-    char *filename = argv[argc - 1];
-    auto infile = std::ifstream(filename);
+    bool collectStats = timePasses || printStats || traceOut;
 
-    if (!infile.is_open()) {
-        std::cout << "Could not find input file '" << filename << "'\n";
+    if (collectStats && (serve || manifest || filenames.size() > 1 || threadsGiven)) {
+        std::cout << "-time-passes, -stats and -trace-out only apply to single file compiles\n";
         return 1;
     }
-    
-    std::ostringstream content;
-    content << infile.rdbuf();
-    std::string sourcestring = content.str();
 
-    Tokenizer tok = Tokenizer(sourcestring);
-    Parser parser = Parser(tok);
+    // resident server keeps its cache warm in memory across requests
+    if (serve) {
+        std::unique_ptr<IRCache> cache;
 
-    auto AST = parser.parseProgram();
+        try {
+            cache = cachedir ? std::make_unique<IRCache>(cachedir, true) : std::make_unique<IRCache>();
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
 
-    // just print AST if this option is specified
-    if (strcmp(argv[1], "-printAST") == 0) {
-        AST->print(0);
-        return 0;
+        sopts.cache = cache.get();
+        return runServer(sopts);
     }
 
-    // output IR with or without pinhole optimization depending on -noopt arg
-    std::unique_ptr<CFG> prgIR = AST->convertToIR();
-        
-    if (strcmp(argv[1], "-noSSA") == 0) {
-        prgIR->outputIR();
-        return 0;
+    // many files compile in one process, one file per pool task
+    if (manifest || filenames.size() > 1 || threadsGiven) {
+        BatchOptions bopts;
+        bopts.inputs = filenames;
+        bopts.outdir = outfile ? outfile : "";
+        bopts.threads = sopts.threads;
+        bopts.compile = opts;
+
+        std::unique_ptr<IRCache> cache;
+
+        try {
+            if (manifest) {
+                auto listed = readManifest(manifest);
+                bopts.inputs.insert(bopts.inputs.end(), listed.begin(), listed.end());
+            }
+
+            if (cachedir) {
+                cache = std::make_unique<IRCache>(cachedir);
+                bopts.compile.cache = cache.get();
+            }
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+
+        if (bopts.compile.printAST) {
+            std::cout << "-printAST cannot be combined with batch compilation\n";
+            return 1;
+        }
+
+        return runBatch(bopts);
     }
 
-    prgIR->convertSSA();
-    
-    if (strcmp(argv[1], "-noVN") == 0) {
-        prgIR->outputIR();
-        return 0;
+    if (filenames.empty()) {
+        std::cout << helpstr;
+        return 1;
+    }
+
+    auto filename = filenames[0];
+
+    // source is mapped read-only and tokenized in place without being copied
+    std::unique_ptr<SourceFile> source;
+    std::unique_ptr<IRCache> cache;
+
+    try {
+        source = std::make_unique<SourceFile>(filename);
+
+        if (cachedir) {
+            cache = std::make_unique<IRCache>(cachedir);
+            opts.cache = cache.get();
+        }
+    } catch (const std::runtime_error &e) {
+        std::cout << e.what() << "\n";
+        return 1;
     }
 
-    prgIR->valueNumberingPass();
-    prgIR->outputIR();
+    PassStats stats;
+    stats.tracing = traceOut != nullptr;
+
+    if (collectStats)
+        opts.stats = &stats;
+
+    try {
+        // all IR goes through one buffered writer, flushed once the program has been emitted
+        auto out = outfile ? std::make_unique<IRWriter>(std::string(outfile)) : std::make_unique<IRWriter>();
+
+        compileSource(source->view(), opts, *out);
+        out->flush();
+
+        if (traceOut)
+            stats.writeTrace(traceOut);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (timePasses)
+        stats.printTimes(stderr);
+
+    if (printStats)
+        stats.printCounters(stderr);
 
     return 0;
 }
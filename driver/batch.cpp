@@ -0,0 +1,125 @@
+// batch.cpp : compiles many programs in one process across a thread pool
+#include "batch.h"
+#include "threadpool.h"
+#include "sourcefile.h"
+#include "irwriter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+std::string batchOutputPath(const std::string &input, const std::string &outdir) {
+    std::filesystem::path out(input);
+    out.replace_extension(".ir");
+
+    if (!outdir.empty())
+        out = std::filesystem::path(outdir) / out.filename();
+
+    return out.string();
+}
+
+std::vector<std::string> readManifest(const std::string &path) {
+    std::ifstream in(path);
+
+    if (!in.is_open())
+        throw std::runtime_error("Could not find manifest '" + path + "'");
+
+    std::vector<std::string> files;
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        files.push_back(line);
+    }
+
+    return files;
+}
+
+int runBatch(const BatchOptions &opts) {
+    if (!opts.outdir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(opts.outdir, ec);
+
+        if (ec) {
+            fprintf(stderr, "Could not create output directory '%s'\n", opts.outdir.c_str());
+            return 1;
+        }
+    }
+
+    // two inputs writing one output at once would leave whichever finished last
+    std::map<std::filesystem::path, std::string> destinations;
+
+    for (const auto &input : opts.inputs) {
+        auto path = std::filesystem::weakly_canonical(batchOutputPath(input, opts.outdir));
+        auto [it, added] = destinations.emplace(path, input);
+
+        if (!added) {
+            fprintf(stderr, "'%s' and '%s' would both be written to '%s'\n", it->second.c_str(), input.c_str(), path.c_str());
+            return 1;
+        }
+    }
+
+    std::mutex reportLock;
+    std::atomic<size_t> failed = 0;
+    std::atomic<size_t> bytesIn = 0;
+    std::atomic<long> compileMicros = 0;
+
+    auto start = Clock::now();
+
+    {
+        ThreadPool pool(opts.threads);
+
+        for (const auto &input : opts.inputs) {
+            pool.submit([&, input] {
+                auto fileStart = Clock::now();
+
+                try {
+                    SourceFile source(input);
+                    bytesIn += source.view().size();
+
+                    // the output file is only created once the whole file compiled
+                    std::string text;
+                    {
+                        auto buf = IRWriter::toString(text);
+                        compileSource(source.view(), opts.compile, buf);
+                    }
+
+                    IRWriter out(batchOutputPath(input, opts.outdir));
+                    out << text;
+                    out.flush();
+                } catch (const std::exception &e) {
+                    failed++;
+
+                    std::lock_guard<std::mutex> guard(reportLock);
+                    fprintf(stderr, "%s: %s\n", input.c_str(), e.what());
+                }
+
+                compileMicros += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - fileStart).count();
+            });
+        }
+
+        pool.wait();
+
+        std::chrono::duration<double> wall = Clock::now() - start;
+        size_t files = opts.inputs.size();
+
+        fprintf(stderr, "batch: %zu files (%zu failed) on %zu threads, %.1f KB of source\n",
+            files, failed.load(), pool.size(), bytesIn / 1024.0);
+        fprintf(stderr, "batch: %.3f s wall, %.3f s summed compile time, %.1f files/s\n",
+            wall.count(), compileMicros / 1e6, wall.count() > 0 ? files / wall.count() : 0.0);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "driver.h"
+
+struct BatchOptions {
+    std::vector<std::string> inputs;
+
+    // directory for outputs, each output is written next to its source when empty
+    std::string outdir;
+
+    // worker threads compiling files, zero picks one per hardware thread
+    size_t threads = 0;
+
+    CompileOptions compile;
+};
+
+// where the IR for a source file goes: the source path with its extension replaced by .ir
+std::string batchOutputPath(const std::string &input, const std::string &outdir);
+
+// read a manifest listing one source file per line, blank lines and lines starting with # are skipped
+std::vector<std::string> readManifest(const std::string &path);
+
+// compile every input across a thread pool and print an aggregate summary
+// returns nonzero if any file failed to compile
+int runBatch(const BatchOptions &opts);
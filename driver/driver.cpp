@@ -0,0 +1,172 @@
+// driver.cpp : runs source text through the frontend and IR passes according to compile options
+#include "driver.h"
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "ASTNodes.h"
+#include "ir.h"
+
+// -noSSA and -noVN cut the requested pipeline short, whatever order they were given in,
+// and -noPhis ends a pipeline that builds SSA by leaving it again,
+// ahead of reuse-temps since no SSA pass can follow that
+static PassManager pipelineFor(const CompileOptions &opts) {
+    if (opts.noSSA)
+        return PassManager("");
+
+    std::string passes;
+    std::string_view rest = opts.passes;
+    bool inSSA = false;
+
+    while (!rest.empty()) {
+        auto comma = rest.find(',');
+        auto name = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? "" : rest.substr(comma + 1);
+
+        if (opts.noVN && (name == "vn" || name == "gvn"))
+            continue;
+
+        if (name == "reuse-temps" && opts.noPhis && inSSA)
+            passes += "out-of-ssa,";
+
+        if (name == "ssa" || name == "pruned-ssa")
+            inSSA = true;
+        else if (name == "out-of-ssa" || name == "reuse-temps")
+            inSSA = false;
+
+        passes += std::string(name) + ',';
+    }
+
+    if (opts.noPhis && inSSA)
+        passes += "out-of-ssa";
+
+    PassManager pipeline(passes);
+    pipeline.budget = opts.budget;
+    return pipeline;
+}
+
+// everything that changes a method's emitted IR besides its own AST and layout dependencies
+static std::string pipelineTag(const PassManager &pipeline, const CompileOptions &opts) {
+    std::string tag = "pipeline " + pipeline.describe() + " budget " + pipeline.budget.describe();
+
+    if (opts.noGCMap)
+        tag += " nogcmap";
+
+    return tag + '\n';
+}
+
+static void compileCached(Program &AST, const PassManager &passes, const CompileOptions &opts, IRWriter &out) {
+    auto layout = AST.buildLayout();
+    layout->gcMaps = !opts.noGCMap;
+    layout->outputData(out);
+
+    auto pipeline = pipelineTag(passes, opts);
+
+    for (auto &unit : AST.methodUnits()) {
+        auto key = pipeline + AST.unitKey(unit, *layout);
+
+        // unchanged methods are spliced in without lowering or optimizing them again
+        if (auto hit = opts.cache->lookup(key)) {
+            if (opts.stats)
+                opts.stats->cacheHits++;
+
+            unit.node->reset();
+            out << *hit;
+            continue;
+        }
+
+        auto method = AST.lowerUnit(unit, *layout);
+        passes.run(*method);
+
+        std::string text;
+        {
+            auto buf = IRWriter::toString(text, 64 * 1024);
+            method->outputIR(buf);
+        }
+
+        opts.cache->store(key, text);
+        out << text;
+    }
+
+    out << "\n";
+}
+
+bool applyCompileFlag(std::string_view flag, CompileOptions &opts) {
+    if (flag == "-printAST")
+        opts.printAST = true;
+    else if (flag == "-noSSA")
+        opts.noSSA = true;
+    else if (flag == "-noVN")
+        opts.noVN = true;
+    else if (flag == "-noGCMap")
+        opts.noGCMap = true;
+    else if (flag == "-noPhis")
+        opts.noPhis = true;
+    else if (flag == "-stream")
+        opts.stream = true;
+    else if (flag == "-noopt")
+        return true;
+    else if (flag.size() == 3 && flag[0] == '-' && flag[1] == 'O' && flag[2] >= '0' && flag[2] <= '3')
+        opts.passes = PassManager::preset(flag[2] - '0');
+    else if (flag.starts_with("-passes="))
+        opts.passes = flag.substr(8);
+    else if (flag.starts_with("-budget="))
+        return opts.budget.parse(flag.substr(8));
+    else
+        return false;
+
+    return true;
+}
+
+void compileSource(std::string_view source, const CompileOptions &opts, IRWriter &out) {
+    ActiveStats active(opts.stats);
+
+    // bad pass lists are reported before any work is done
+    auto passes = pipelineFor(opts);
+
+    // tokens are produced on demand by the parser, so tokenizing is timed as part of parsing
+    ProgramPtr AST;
+    {
+        PassTimer timer("parse");
+        Parser parser = Parser(Tokenizer(source));
+        AST = parser.parseProgram();
+    }
+
+    {
+        PassTimer timer("typecheck");
+        AST->typeCheck();
+    }
+
+    // just print AST if this option is specified
+    if (opts.printAST) {
+        AST->print(0);
+        return;
+    }
+
+    if (opts.cache) {
+        compileCached(*AST, passes, opts, out);
+        return;
+    }
+
+    // streaming keeps at most one method's AST and IR alive past this point
+    if (opts.stream) {
+        auto layout = AST->buildLayout();
+        layout->gcMaps = !opts.noGCMap;
+        layout->outputData(out);
+
+        AST->streamIR(*layout, [&](std::shared_ptr<MethodIR> method) {
+            passes.run(*method);
+            method->outputIR(out);
+        });
+
+        // matches the blank line CFG::outputIR leaves after the last method
+        out << "\n";
+        return;
+    }
+
+    std::unique_ptr<CFG> prgIR = AST->convertToIR(!opts.noGCMap);
+
+    for (auto &[_, method] : prgIR->methodinfo)
+        passes.run(*method);
+
+    prgIR->outputIR(out);
+}
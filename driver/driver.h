@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "irwriter.h"
+#include "ircache.h"
+#include "passstats.h"
+#include "passmanager.h"
+
+struct CompileOptions {
+    bool printAST = false;
+    // comma separated passes run over every method, set by -passes= and the -O presets
+    std::string passes = PassManager::preset(1);
+
+    // stop before SSA construction, or drop value numbering from the pipeline
+    bool noSSA = false;
+    bool noVN = false;
+
+    // translate out of SSA at the end of the pipeline, so the IR has no phis
+    bool noPhis = false;
+
+    // per-method size limits past which expensive passes are degraded or skipped
+    CompileBudget budget;
+
+    // leave out gc map stores so the IR runs under ir441's perf and trace modes
+    bool noGCMap = false;
+
+    // lower, optimize and emit one method at a time
+    bool stream = false;
+
+    // reuse optimized IR of unchanged methods, implies compiling method by method
+    const IRCache *cache = nullptr;
+
+    // collects phase timings and pass counters when set
+    PassStats *stats = nullptr;
+};
+
+// set the option named by a command line flag, returns false for flags that are not compile options
+bool applyCompileFlag(std::string_view flag, CompileOptions &opts);
+
+// run the whole pipeline over a program's source text and write the resulting IR
+// parse and type errors are reported by throwing std::runtime_error
+void compileSource(std::string_view source, const CompileOptions &opts, IRWriter &out);
@@ -0,0 +1,306 @@
+// server.cpp : resident compile server answering length-prefixed requests on a unix socket or stdin
+//
+// every integer in the protocol is a little endian 32 bit value
+//   request:  id, flags length, flags (space separated compiler flags), source length, source
+//   response: id, status (0 for IR, 1 for diagnostics), latency in microseconds, payload length, payload
+#include "server.h"
+#include "driver.h"
+#include "threadpool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using Clock = std::chrono::steady_clock;
+
+// longer lengths are taken for a corrupt frame rather than allocated
+static constexpr uint32_t maxFlagsLength = 64 * 1024;
+static constexpr uint32_t maxSourceLength = 64 << 20;
+
+struct Request {
+    uint32_t id;
+    std::string flags;
+    std::string source;
+    Clock::time_point received;
+
+    // why the frame was refused unread, nothing after it on the connection can be made sense of
+    std::string rejected;
+};
+
+static bool readFull(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        auto got = read(fd, buf, len);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            return false;
+
+        buf += got;
+        len -= got;
+    }
+
+    return true;
+}
+
+static bool writeFull(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        auto written = write(fd, buf, len);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        buf += written;
+        len -= written;
+    }
+
+    return true;
+}
+
+static bool readU32(int fd, uint32_t &val) {
+    unsigned char bytes[4];
+
+    if (!readFull(fd, reinterpret_cast<char *>(bytes), 4))
+        return false;
+
+    val = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+    return true;
+}
+
+static void appendU32(std::string &frame, uint32_t val) {
+    for (int i = 0; i < 4; i++)
+        frame += static_cast<char>((val >> (8 * i)) & 0xff);
+}
+
+static bool readRequest(int fd, Request &req) {
+    uint32_t len;
+
+    auto reject = [&](const char *what, uint32_t limit) {
+        req.rejected = "Request " + std::to_string(req.id) + " has " + std::to_string(len) + " bytes of " + what +
+            ", more than the limit of " + std::to_string(limit);
+        req.received = Clock::now();
+        return true;
+    };
+
+    if (!readU32(fd, req.id) || !readU32(fd, len))
+        return false;
+
+    if (len > maxFlagsLength)
+        return reject("flags", maxFlagsLength);
+
+    req.flags.resize(len);
+    if (!readFull(fd, req.flags.data(), len) || !readU32(fd, len))
+        return false;
+
+    if (len > maxSourceLength)
+        return reject("source", maxSourceLength);
+
+    req.source.resize(len);
+    if (!readFull(fd, req.source.data(), len))
+        return false;
+
+    req.received = Clock::now();
+    return true;
+}
+
+// per-request latencies, reported as they happen and summarized on shutdown
+class LatencyLog {
+    std::mutex lock;
+    std::vector<double> latencies;
+    size_t failures = 0;
+
+public:
+    void record(const Request &req, bool ok, double queuedMs, double compileMs, size_t outBytes) {
+        std::lock_guard<std::mutex> guard(lock);
+
+        latencies.push_back(queuedMs + compileMs);
+        if (!ok)
+            failures++;
+
+        fprintf(stderr, "serve: request %u %s, %zu bytes in, %zu bytes out, queued %.3f ms, compiled %.3f ms\n",
+            req.id, ok ? "ok" : "failed", req.source.size(), outBytes, queuedMs, compileMs);
+    }
+
+    void summary() {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (latencies.empty())
+            return;
+
+        std::sort(latencies.begin(), latencies.end());
+
+        double total = 0;
+        for (auto l : latencies)
+            total += l;
+
+        auto pct = [&](double p) { return latencies[std::min(latencies.size() - 1, (size_t) (p * latencies.size()))]; };
+
+        fprintf(stderr, "serve: %zu requests (%zu failed), latency mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            latencies.size(), failures, total / latencies.size(), pct(0.5), pct(0.99), latencies.back());
+    }
+};
+
+// compile one request into a response frame
+static std::string serve(const Request &req, const ServerOptions &sopts, LatencyLog &log) {
+    // output buffer stays with the worker thread so its capacity carries over between requests
+    thread_local std::string output;
+    output.clear();
+
+    auto start = Clock::now();
+    bool ok = true;
+
+    try {
+        if (!req.rejected.empty())
+            throw std::runtime_error(req.rejected);
+
+        CompileOptions opts;
+        opts.cache = sopts.cache;
+
+        std::istringstream flags(req.flags);
+        std::string flag;
+
+        while (flags >> flag) {
+            if (flag == "-printAST" || !applyCompileFlag(flag, opts))
+                throw std::runtime_error("Unsupported flag for compile server: " + flag);
+        }
+
+        auto out = IRWriter::toString(output, 64 * 1024);
+        compileSource(req.source, opts, out);
+        out.flush();
+    } catch (const std::exception &e) {
+        ok = false;
+        output = e.what();
+    }
+
+    auto done = Clock::now();
+    std::chrono::duration<double, std::milli> queued = start - req.received;
+    std::chrono::duration<double, std::milli> compiled = done - start;
+
+    log.record(req, ok, queued.count(), compiled.count(), output.size());
+
+    std::string frame;
+    frame.reserve(output.size() + 16);
+    appendU32(frame, req.id);
+    appendU32(frame, ok ? 0 : 1);
+    appendU32(frame, (uint32_t) ((queued.count() + compiled.count()) * 1000));
+    appendU32(frame, output.size());
+    frame += output;
+
+    return frame;
+}
+
+static int serveStdin(const ServerOptions &opts) {
+    // responses get the real stdout, anything else printed there is sent to stderr instead of corrupting frames
+    int respfd = dup(1);
+    dup2(2, 1);
+
+    LatencyLog log;
+    std::mutex writeLock;
+
+    {
+        ThreadPool pool(opts.threads);
+
+        while (true) {
+            auto req = std::make_shared<Request>();
+
+            if (!readRequest(0, *req))
+                break;
+
+            pool.submit([req, &opts, &log, &writeLock, respfd] {
+                auto frame = serve(*req, opts, log);
+
+                std::lock_guard<std::mutex> guard(writeLock);
+                writeFull(respfd, frame.data(), frame.size());
+            });
+
+            if (!req->rejected.empty())
+                break;
+        }
+
+        pool.wait();
+    }
+
+    log.summary();
+    close(respfd);
+    return 0;
+}
+
+static int serveSocket(const ServerOptions &opts) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (opts.socketPath.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << opts.socketPath << "\n";
+        return 1;
+    }
+
+    opts.socketPath.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(opts.socketPath.c_str());
+
+    if (sock < 0 || bind(sock, (sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, 64) < 0) {
+        std::cerr << "Could not listen on socket '" << opts.socketPath << "'\n";
+        return 1;
+    }
+
+    // a client hanging up mid-response should only drop that connection
+    signal(SIGPIPE, SIG_IGN);
+
+    LatencyLog log;
+    ThreadPool pool(opts.threads);
+
+    std::cerr << "serve: listening on " << opts.socketPath << " with " << pool.size() << " threads\n";
+
+    while (true) {
+        int conn = accept(sock, nullptr, nullptr);
+
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            break;
+        }
+
+        // requests on one connection are answered in order, connections are served concurrently
+        pool.submit([conn, &opts, &log] {
+            Request req;
+
+            while (readRequest(conn, req)) {
+                auto frame = serve(req, opts, log);
+
+                if (!writeFull(conn, frame.data(), frame.size()) || !req.rejected.empty())
+                    break;
+            }
+
+            close(conn);
+        });
+    }
+
+    pool.wait();
+    log.summary();
+    close(sock);
+    return 1;
+}
+
+int runServer(const ServerOptions &opts) {
+    if (opts.socketPath.empty())
+        return serveStdin(opts);
+
+    return serveSocket(opts);
+}
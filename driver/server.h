@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+#include "ircache.h"
+
+struct ServerOptions {
+    // unix domain socket to listen on, requests are read from stdin when empty
+    std::string socketPath;
+
+    // worker threads serving requests, zero picks one per hardware thread
+    size_t threads = 0;
+
+    // shared by every request so methods compiled once are reused by later requests
+    const IRCache *cache = nullptr;
+};
+
+// serve compile requests until stdin closes (or forever on a socket)
+int runServer(const ServerOptions &opts);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads pulling tasks off a shared queue
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable idle;
+
+    size_t running = 0;
+    bool stopping = false;
+
+    void work();
+
+public:
+    // zero threads picks one per hardware thread
+    explicit ThreadPool(size_t threads = 0);
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // finishes every queued task before joining the workers
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    // block until the queue is empty and no task is running
+    void wait();
+
+    size_t size() const { return workers.size(); }
+};
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <functional>
+#include <set>
 #include "ir.h"
 
 // forward declare IRBuilder because I didn't design this with a pattern like I clearly should have
@@ -32,12 +34,21 @@ struct TypeEnv {
     Method* curMethod;
 };
 
+// textual summary of a method's AST used to key cached IR
+// also records the class layouts and vtable slots that lowering the method reads
+struct Fingerprint {
+    std::string text;
+    std::set<std::string> classes;
+    std::set<std::string> methods;
+};
+
 struct Expression : ASTNode {
     virtual ~Expression();
     virtual ValPtr convertToIR(IRBuilder& builder, LclPtr out) const;
     std::string type;
 
     virtual std::string getType(const TypeEnv& tenv) = 0;
+    virtual void fingerprint(Fingerprint& fp) const = 0;
 };
 
 using ExprPtr = std::unique_ptr<Expression>;
@@ -50,6 +61,7 @@ struct ThisExpr : public Expression {
 
     ValPtr convertToIR(IRBuilder& builder, LclPtr out = nullptr) const override;
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct NullExpr : public Expression {
@@ -64,6 +76,7 @@ struct NullExpr : public Expression {
     }
 
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct Constant : public Expression {
@@ -82,6 +95,7 @@ struct Constant : public Expression {
         }
 
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct ClassRef : Expression {
@@ -98,6 +112,7 @@ struct ClassRef : Expression {
         classname(std::move(cname)) {}
 
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct Binop : Expression {
@@ -121,6 +136,7 @@ struct Binop : Expression {
         lhs(std::move(left)), rhs(std::move(right)), op(oper) {}
 
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct FieldRead : Expression {
@@ -142,6 +158,7 @@ struct FieldRead : Expression {
         base(std::move(b)), fieldname(std::move(fname)) {}
 
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct Var : Expression {
@@ -157,6 +174,7 @@ struct Var : Expression {
     Var(std::string n): name(std::move(n)) {};
 
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct MethodCall : Expression {
@@ -187,6 +205,7 @@ struct MethodCall : Expression {
         base(std::move(b)), methodname(std::move(mname)), args(std::move(arglist)) {}
     
     std::string getType(const TypeEnv& tenv) override;
+    void fingerprint(Fingerprint& fp) const override;
 };
 
 struct Statement : ASTNode {
@@ -194,6 +213,7 @@ struct Statement : ASTNode {
     virtual void convertToIR(IRBuilder& builder) const;
 
     virtual void typeCheck(const TypeEnv& tenv) const = 0;
+    virtual void fingerprint(Fingerprint& fp) const = 0;
 };
 
 using StmtPtr = std::unique_ptr<Statement>;
@@ -216,6 +236,7 @@ struct AssignStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
     
     AssignStatement(std::string name, ExprPtr value): 
         name(std::move(name)), value(std::move(value)) {}
@@ -235,6 +256,7 @@ struct DiscardStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
     
     explicit DiscardStatement(ExprPtr expr): 
         expr(std::move(expr)) {}
@@ -263,6 +285,7 @@ struct FieldAssignStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
     
     FieldAssignStatement(ExprPtr object, std::string field, ExprPtr value): 
         object(std::move(object)), field(std::move(field)), value(std::move(value)) {}
@@ -296,6 +319,7 @@ struct IfStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
     
     IfStatement(ExprPtr condition, std::vector<StmtPtr> thenBranch, std::vector<StmtPtr> elseBranch): 
         condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
@@ -321,6 +345,7 @@ struct IfOnlyStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
     
     IfOnlyStatement(ExprPtr condition, std::vector<StmtPtr> body): 
         condition(std::move(condition)), body(std::move(body)) {}
@@ -346,6 +371,7 @@ struct WhileStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
 
     WhileStatement(ExprPtr condition, std::vector<StmtPtr> body): 
         condition(std::move(condition)), body(std::move(body)) {}
@@ -365,6 +391,7 @@ struct ReturnStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
 
     explicit ReturnStatement(ExprPtr value): 
         value(std::move(value)) {}
@@ -384,6 +411,7 @@ struct PrintStatement : Statement {
 
     void convertToIR(IRBuilder& builder) const override;
     void typeCheck(const TypeEnv& tenv) const override;
+    void fingerprint(Fingerprint& fp) const override;
     
     explicit PrintStatement(ExprPtr value): 
         value(std::move(value)) {}
@@ -409,9 +437,11 @@ struct Method : ASTNode {
     std::shared_ptr<MethodIR> convertToIR(std::string classname, 
         std::map<std::string, std::unique_ptr<ClassMetadata>>& cls,
         std::vector<std::string>& mthd,
-        bool mainmethod) const;
+        bool mainmethod,
+        bool gcMaps = true) const;
 
     void typeCheck(std::map<std::string, ClassPtr>& classes, Class* curClass);
+    void fingerprint(Fingerprint& fp) const;
 
     void print(int ind) const override {
         indent(ind);
@@ -470,6 +500,15 @@ struct Class : ASTNode {
 
 using ClassPtr = std::unique_ptr<Class>;
 
+// a single method of the program, listed in the order its IR is emitted
+struct MethodUnit {
+    std::string irname;
+    std::string classname;
+
+    // slot that owns the method's AST so it can be released once the method is lowered
+    MethodPtr *node;
+};
+
 struct Program : ASTNode {
     MethodPtr main;
     std::map<std::string, ClassPtr> classes;
@@ -477,9 +516,22 @@ struct Program : ASTNode {
     Program(MethodPtr mainmethod, std::map<std::string, ClassPtr> classlist)
         : main(std::move(mainmethod)), classes(std::move(classlist)) {}
 
-    std::unique_ptr<CFG> convertToIR() const;
+    std::unique_ptr<CFG> convertToIR(bool gcMaps = true) const;
     void typeCheck();
 
+    // class layouts and vtables without any method bodies
+    std::unique_ptr<CFG> buildLayout() const;
+    std::vector<MethodUnit> methodUnits();
+
+    // lower a single method against a layout and release its AST
+    std::shared_ptr<MethodIR> lowerUnit(MethodUnit& unit, CFG& layout);
+
+    // lower methods one at a time, releasing each method's AST before handing its IR to the consumer
+    void streamIR(CFG& layout, const std::function<void(std::shared_ptr<MethodIR>)>& consume);
+
+    // key identifying a method's IR: its AST plus every class layout and vtable slot it depends on
+    std::string unitKey(const MethodUnit& unit, const CFG& layout) const;
+
     void print(int ind) const override {
         indent(ind);
         std::cout << "Program\n";
@@ -1,5 +1,6 @@
 #include "ASTNodes.h"
 #include "irbuilder.h"
+#include "passstats.h"
 
 ValPtr ThisExpr::convertToIR(IRBuilder& builder, LclPtr out) const {
     auto newLocal = std::make_shared<Local>(Local("this", 0));
@@ -63,6 +64,10 @@ ValPtr ClassRef::convertToIR(IRBuilder& builder, LclPtr out) const {
     auto storeVtbl = std::make_unique<Store>(var, vtable);
     builder.addInstruction(std::move(storeVtbl));
 
+    // instrumented interpreter modes do not reserve the word in front of objects
+    if (!builder.emitGCMaps)
+        return var;
+
     // get prior address (to store layout)
     auto gcMapAddr = builder.getNextTemp();
     builder.addInstruction(std::move(std::make_unique<BinInst>(gcMapAddr, Oper::Sub, var, std::make_shared<Const>(8))));
@@ -74,10 +79,6 @@ ValPtr ClassRef::convertToIR(IRBuilder& builder, LclPtr out) const {
 }
 
 ValPtr Binop::convertToIR(IRBuilder& builder, LclPtr out) const {
-    // make sure every value passed into binop is placed in a local so that tagging and untagging can be done
-    auto lOut = builder.getNextTemp();
-    auto rOut = builder.getNextTemp();
-    
     auto result = out ? out : builder.getNextTemp();
 
     // operations by default allow for only ints, but equal and not equal allow pointers to be considered
@@ -111,8 +112,10 @@ ValPtr Binop::convertToIR(IRBuilder& builder, LclPtr out) const {
             throw std::runtime_error("Unknown Operation: " + op);
     }
 
-    auto lhsVar = lhs->convertToIR(builder, lOut);
-    auto rhsVar = rhs->convertToIR(builder, rOut);
+    // constants and variables become operands directly, only nested expressions get a temp of their own
+    // expressions never assign, so reading a variable after the other side is evaluated sees the same value
+    auto lhsVar = lhs->convertToIR(builder, nullptr);
+    auto rhsVar = rhs->convertToIR(builder, nullptr);
 
     auto binInst = std::make_unique<BinInst>(result, optype, lhsVar, rhsVar);
     builder.addInstruction(std::move(binInst));
@@ -122,16 +125,9 @@ ValPtr Binop::convertToIR(IRBuilder& builder, LclPtr out) const {
 
 ValPtr FieldRead::convertToIR(IRBuilder& builder, LclPtr out) const {
     auto objVar = base->convertToIR(builder, nullptr);
-    auto target = out ? out : builder.getNextTemp();
-
     int fieldOffset = builder.getFieldOffset(base->type, fieldname);
 
-    auto fieldAddr = builder.getNextTemp();
-    builder.addInstruction(std::move(std::make_unique<BinInst>(fieldAddr, Oper::Add, objVar, std::make_shared<Const>(fieldOffset))));
-
-    builder.addInstruction(std::move(std::make_unique<Load>(target, fieldAddr)));
-
-    return target;
+    return builder.loadSlot(objVar, fieldOffset, out);
 }
 
 ValPtr MethodCall::convertToIR(IRBuilder& builder, LclPtr out) const {
@@ -144,8 +140,7 @@ ValPtr MethodCall::convertToIR(IRBuilder& builder, LclPtr out) const {
     builder.addInstruction(std::move(std::make_unique<Load>(vtable, objVar)));
 
     auto methodIndex = builder.getMethodOffset(methodname);
-    auto funcEntry = builder.getNextTemp();
-    builder.addInstruction(std::move(std::make_unique<GetElt>(funcEntry, vtable, std::make_shared<Const>(methodIndex))));
+    auto funcEntry = builder.loadSlot(vtable, methodIndex, nullptr);
 
     // object passed to first argument for %this
     std::vector<ValPtr> argVars;
@@ -174,11 +169,7 @@ void FieldAssignStatement::convertToIR(IRBuilder& builder) const {
     auto targetVal = value->convertToIR(builder, nullptr);
 
     int fieldOffset = builder.getFieldOffset(object->type, field);
-
-    auto fieldAddr = builder.getNextTemp();
-    builder.addInstruction(std::move(std::make_unique<BinInst>(fieldAddr, Oper::Add, objVar, std::make_shared<Const>(fieldOffset))));
-
-    builder.addInstruction(std::move(std::make_unique<Store>(fieldAddr, targetVal)));
+    builder.storeSlot(objVar, fieldOffset, targetVal);
 }
 
 void IfStatement::convertToIR(IRBuilder& builder) const {
@@ -227,13 +218,9 @@ void IfOnlyStatement::convertToIR(IRBuilder& builder) const {
 }
 
 void WhileStatement::convertToIR(IRBuilder& builder) const {
-    // separate block to evaluate condition to make it easier to jump back to later
-    auto condBlock = builder.createBlock();
-    builder.terminate(std::move(std::make_unique<Jump>(condBlock)));
-    
-    builder.setCurrentBlock(condBlock);
-
-    auto condVar = condition->convertToIR(builder, nullptr);   
+    // rotated into a guarded do-while, the condition is evaluated once before the loop as a guard and again
+    // at the bottom of the body, so an iteration ends in one conditional branch instead of a jump back to the test
+    auto condVar = condition->convertToIR(builder, nullptr);
     
     auto bodyBlock = builder.createBlock();
     auto mergeBlock = builder.createBlock();
@@ -242,8 +229,10 @@ void WhileStatement::convertToIR(IRBuilder& builder) const {
     builder.setCurrentBlock(bodyBlock);
 
     auto terminated = builder.processBlock(body);
-    if (!terminated)
-        builder.terminate(std::move(std::make_unique<Jump>(condBlock)));
+    if (!terminated) {
+        auto again = condition->convertToIR(builder, nullptr);
+        builder.terminate(std::move(std::make_unique<Conditional>(again, bodyBlock, mergeBlock)));
+    }
     
     builder.setCurrentBlock(mergeBlock);
 }
@@ -261,9 +250,11 @@ void PrintStatement::convertToIR(IRBuilder& builder) const {
 std::shared_ptr<MethodIR> Method::convertToIR(std::string classname, 
         std::map<std::string, std::unique_ptr<ClassMetadata>>& cls, 
         std::vector<std::string>& mthd,
-        bool mainmethod = false) const {
+        bool mainmethod,
+        bool gcMaps) const {
 
     auto nm = mainmethod ? "main" : classname + '_' + name;
+    PassTimer timer("lower", nm);
 
     // push type for this since it wasn't needed in the prior pass
     auto typedArs = typedArgs;
@@ -271,6 +262,7 @@ std::shared_ptr<MethodIR> Method::convertToIR(std::string classname,
     
     auto ret = std::make_shared<MethodIR>(nm, typedLcls, typedArs);
     auto builder = IRBuilder(ret, cls, mthd);
+    builder.emitGCMaps = gcMaps;
 
     for (auto &[name, _] : typedLcls) {
         auto varVersion = std::make_shared<Local>(name, 0);
@@ -285,12 +277,11 @@ std::shared_ptr<MethodIR> Method::convertToIR(std::string classname,
     return ret;
 };
 
-std::unique_ptr<CFG> Program::convertToIR() const {
+std::unique_ptr<CFG> Program::buildLayout() const {
     std::set<std::string> methodset;
     std::vector<std::string> methods;
 
     std::map<std::string, std::unique_ptr<ClassMetadata>> classinfo;
-    std::map<std::string, std::shared_ptr<MethodIR>> methodinfo;
 
     // Collect global field + method names
     for (const auto& [_, cls] : classes) {
@@ -327,17 +318,58 @@ std::unique_ptr<CFG> Program::convertToIR() const {
         }
     }
 
+    return std::move(std::make_unique<CFG>(methods, std::move(classinfo), std::map<std::string, std::shared_ptr<MethodIR>>()));
+}
+
+std::vector<MethodUnit> Program::methodUnits() {
+    // keyed by IR name so units come out in the same order as CFG::methodinfo
+    std::map<std::string, MethodUnit> units;
+
+    for (auto& [_, cls] : classes) {
+        for (auto& [_, method] : cls->methods) {
+            auto nm = cls->name + '_' + method->name;
+            units.insert_or_assign(nm, MethodUnit{nm, cls->name, &method});
+        }
+    }
+
+    units.insert_or_assign("main", MethodUnit{"main", "", &main});
+
+    std::vector<MethodUnit> ret;
+    for (auto& [_, unit] : units)
+        ret.push_back(unit);
+
+    return ret;
+}
+
+std::unique_ptr<CFG> Program::convertToIR(bool gcMaps) const {
+    auto cfg = buildLayout();
+    cfg->gcMaps = gcMaps;
+
     for (const auto& [_, cls] : classes) {
         for (const auto& [_, method] : cls->methods) {
-            std::shared_ptr<MethodIR> ir = method->convertToIR(cls->name, classinfo, methods, false);
+            std::shared_ptr<MethodIR> ir = method->convertToIR(cls->name, cfg->classinfo, cfg->classmethods, false, gcMaps);
 
             auto nm = cls->name + '_' + method->name;
-            methodinfo[nm] = ir;
+            cfg->methodinfo[nm] = ir;
         }
     }
 
-    std::shared_ptr<MethodIR> mainir = main->convertToIR("", classinfo, methods, true);
-    methodinfo["main"] = mainir;
+    std::shared_ptr<MethodIR> mainir = main->convertToIR("", cfg->classinfo, cfg->classmethods, true, gcMaps);
+    cfg->methodinfo["main"] = mainir;
+
+    return cfg;
+}
+
+std::shared_ptr<MethodIR> Program::lowerUnit(MethodUnit& unit, CFG& layout) {
+    auto ir = (*unit.node)->convertToIR(unit.classname, layout.classinfo, layout.classmethods, unit.node == &main, layout.gcMaps);
+
+    // method bodies are no longer needed once lowered, type checking has already run over the whole program
+    unit.node->reset();
+
+    return ir;
+}
 
-    return std::move(std::make_unique<CFG>(methods, std::move(classinfo), std::move(methodinfo)));
+void Program::streamIR(CFG& layout, const std::function<void(std::shared_ptr<MethodIR>)>& consume) {
+    for (auto& unit : methodUnits())
+        consume(lowerUnit(unit, layout));
 }
@@ -0,0 +1,158 @@
+// fingerprint.cpp : serializes method ASTs into cache keys for incremental compilation
+#include "ASTNodes.h"
+
+// every node writes a one character tag followed by its contents
+// identifiers never contain ';' or brackets, so the encoding stays unambiguous
+
+static void fingerprintBody(const std::vector<StmtPtr>& body, Fingerprint& fp) {
+    fp.text += '{';
+
+    for (const auto& stmt : body)
+        stmt->fingerprint(fp);
+
+    fp.text += '}';
+}
+
+void ThisExpr::fingerprint(Fingerprint& fp) const {
+    fp.text += 'T';
+}
+
+void NullExpr::fingerprint(Fingerprint& fp) const {
+    fp.text += 'N' + type + ';';
+}
+
+void Constant::fingerprint(Fingerprint& fp) const {
+    fp.text += 'C' + std::to_string(value) + ';';
+}
+
+void ClassRef::fingerprint(Fingerprint& fp) const {
+    // allocation size and gc map both come from the class layout
+    fp.classes.insert(classname);
+    fp.text += '@' + classname + ';';
+}
+
+void Binop::fingerprint(Fingerprint& fp) const {
+    fp.text += 'B';
+    fp.text += op;
+    fp.text += '(';
+    lhs->fingerprint(fp);
+    rhs->fingerprint(fp);
+    fp.text += ')';
+}
+
+void FieldRead::fingerprint(Fingerprint& fp) const {
+    // field offset depends on the layout of the base's class
+    fp.classes.insert(base->type);
+    fp.text += '&' + base->type + '.' + fieldname + '(';
+    base->fingerprint(fp);
+    fp.text += ')';
+}
+
+void Var::fingerprint(Fingerprint& fp) const {
+    fp.text += 'V' + name + ';';
+}
+
+void MethodCall::fingerprint(Fingerprint& fp) const {
+    // vtable slot is the method's index in the global method list
+    fp.methods.insert(methodname);
+    fp.text += '^' + methodname + '(';
+    base->fingerprint(fp);
+
+    for (const auto& arg : args)
+        arg->fingerprint(fp);
+
+    fp.text += ')';
+}
+
+void AssignStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += '=' + name + ';';
+    value->fingerprint(fp);
+}
+
+void DiscardStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += '_';
+    expr->fingerprint(fp);
+}
+
+void FieldAssignStatement::fingerprint(Fingerprint& fp) const {
+    fp.classes.insert(object->type);
+    fp.text += '!' + object->type + '.' + field + ';';
+    object->fingerprint(fp);
+    value->fingerprint(fp);
+}
+
+void IfStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += 'I';
+    condition->fingerprint(fp);
+    fingerprintBody(thenBranch, fp);
+    fingerprintBody(elseBranch, fp);
+}
+
+void IfOnlyStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += 'O';
+    condition->fingerprint(fp);
+    fingerprintBody(body, fp);
+}
+
+void WhileStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += 'W';
+    condition->fingerprint(fp);
+    fingerprintBody(body, fp);
+}
+
+void ReturnStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += 'R';
+    value->fingerprint(fp);
+}
+
+void PrintStatement::fingerprint(Fingerprint& fp) const {
+    fp.text += 'P';
+    value->fingerprint(fp);
+}
+
+void Method::fingerprint(Fingerprint& fp) const {
+    fp.text += "method " + name + '(';
+
+    for (const auto& [aname, atype] : typedArgs)
+        fp.text += aname + ':' + atype + ',';
+
+    fp.text += ")" + retType + " locals ";
+
+    for (const auto& [lname, ltype] : typedLcls)
+        fp.text += lname + ':' + ltype + ',';
+
+    fingerprintBody(body, fp);
+}
+
+std::string Program::unitKey(const MethodUnit& unit, const CFG& layout) const {
+    Fingerprint fp;
+    fp.text = unit.irname + " in " + unit.classname + '\n';
+
+    (*unit.node)->fingerprint(fp);
+    fp.text += '\n';
+
+    // field order, and therefore every offset, size and gc map of a class comes from its field list
+    for (const auto& cls : fp.classes) {
+        fp.text += "layout " + cls + ':';
+
+        auto info = layout.classinfo.find(cls);
+        if (info != layout.classinfo.end())
+            for (const auto& [fname, ftype] : info->second->typedFields)
+                fp.text += fname + ':' + ftype + ',';
+
+        fp.text += '\n';
+    }
+
+    // slots shift whenever a method name is added to or removed from the program
+    for (const auto& mname : fp.methods) {
+        int slot = -1;
+
+        for (size_t i = 0; i < layout.classmethods.size(); i++)
+            if (layout.classmethods[i] == mname)
+                slot = i;
+
+        fp.text += "slot " + mname + '=' + std::to_string(slot) + '\n';
+    }
+
+    return fp.text;
+}
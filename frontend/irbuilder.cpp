@@ -1,4 +1,5 @@
 #include "irbuilder.h"
+#include "passstats.h"
  
 BasicBlock* IRBuilder::createBlock() {
     return method->newBasicBlock();
@@ -22,6 +23,10 @@ void IRBuilder::terminate(std::unique_ptr<ControlTransfer> blockTerm) {
 LclPtr IRBuilder::getNextTemp() {
     auto nxtTmp = "tmp" + std::to_string(nexttmp++);
     method->registerTemp(nxtTmp);
+
+    if (auto stats = PassStats::active())
+        stats->temps++;
+
     return std::make_shared<Local>(nxtTmp, 0, true);
 }
 
@@ -35,14 +40,39 @@ int IRBuilder::getClassSize(std::string classname) {
 int IRBuilder::getFieldOffset(std::string type, std::string fieldname) {
     for (int i = 0; i < classes[type]->typedFields.size(); i++) {
         if (classes[type]->typedFields[i].first == fieldname) {
-            // field offset is offset by 1 to account for vtable and multiplied by 8 to align with 64 bit values
-            return 8 * (i + 1);
+            // slot index of the field, slot 0 holds the vtable
+            return i + 1;
         }
     }
     
     throw std::runtime_error("Could not find field: " + fieldname);
 }
 
+// address mode selection for a slot at a constant index
+// ir441 charges getelt/setelt a slow ALU op for scaling the index, so an add of the byte offset followed by a
+// load or store is cheaper, and slot 0 is addressed by base alone
+ValPtr IRBuilder::slotAddress(ValPtr base, int slot) {
+    if (slot == 0)
+        return base;
+
+    auto addr = getNextTemp();
+    addInstruction(std::make_unique<BinInst>(addr, Oper::Add, base, std::make_shared<Const>(8 * slot)));
+    return addr;
+}
+
+ValPtr IRBuilder::loadSlot(ValPtr base, int slot, LclPtr out) {
+    auto addr = slotAddress(std::move(base), slot);
+    auto target = out ? out : getNextTemp();
+
+    addInstruction(std::make_unique<Load>(target, addr));
+    return target;
+}
+
+void IRBuilder::storeSlot(ValPtr base, int slot, ValPtr val) {
+    auto addr = slotAddress(std::move(base), slot);
+    addInstruction(std::make_unique<Store>(addr, std::move(val)));
+}
+
 int IRBuilder::getMethodOffset(std::string method) {
     for (size_t i = 0; i < methods.size(); i++)
         if (methods[i] == method)
@@ -13,7 +13,12 @@ class IRBuilder {
     BasicBlock* current;
     int nexttmp = 1;
 
+    ValPtr slotAddress(ValPtr base, int slot);
+
 public:
+    // store each allocated object's gc map in the word before it
+    bool emitGCMaps = true;
+
     IRBuilder(std::shared_ptr<MethodIR> m, 
         std::map<std::string, std::unique_ptr<ClassMetadata>>& cls, 
         std::vector<std::string>& mthd):
@@ -39,6 +44,10 @@ public:
 
     int getMethodOffset(std::string method);
 
+    // read or write word slot of an object or table, choosing the cheapest addressing for the index
+    ValPtr loadSlot(ValPtr base, int slot, LclPtr out);
+    void storeSlot(ValPtr base, int slot, ValPtr val);
+
     unsigned long getGCMap(std::string classname);
 
     // Process a set of statements from the current position
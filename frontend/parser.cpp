@@ -474,10 +474,6 @@ ProgramPtr Parser::parseProgram() {
     } while (tok.next().type == NEWLINE && tok.peekNext().type != ENDOFFILE);
 
     MethodPtr m = std::make_unique<Method>(mname, std::move(args), std::move(locals), std::move(statements), "int");
-    auto prg = std::make_unique<Program>(std::move(m), std::move(classes));
-
-    // perform type checking pass before returning parsed program
-    prg->typeCheck();
-
-    return prg;
+    // type checking is left to the caller as a separate pass
+    return std::make_unique<Program>(std::move(m), std::move(classes));
 }
@@ -9,7 +9,7 @@ private:
 
 public:
     Parser(Tokenizer t) :
-        tok(t) {};
+        tok(std::move(t)) {};
 
     ExprPtr parseExpr();
     StmtPtr parseStatement();
@@ -0,0 +1,75 @@
+#include "sourcefile.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+SourceFile::SourceFile(const std::string &path) {
+    if (path == "-") {
+        readAll(0);
+        return;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        throw std::runtime_error("Could not find input file '" + path + "'");
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (addr != MAP_FAILED) {
+            // the tokenizer walks the file front to back exactly once
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+            data = static_cast<const char *>(addr);
+            size = st.st_size;
+            mapped = true;
+
+            close(fd);
+            return;
+        }
+    }
+
+    // fall back on plain reads for anything that cannot be mapped
+    try {
+        readAll(fd);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+}
+
+SourceFile::~SourceFile() {
+    if (mapped)
+        munmap(const_cast<char *>(data), size);
+}
+
+void SourceFile::readAll(int fd) {
+    char chunk[64 * 1024];
+
+    while (true) {
+        auto got = read(fd, chunk, sizeof(chunk));
+
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+
+            throw std::runtime_error("Failed reading source input");
+        }
+
+        if (got == 0)
+            break;
+
+        buffer.append(chunk, got);
+    }
+
+    data = buffer.data();
+    size = buffer.size();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file
+// Regular files are mapped straight into memory, while pipes and stdin (given as "-") are read into an owned buffer
+class SourceFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer;
+
+    void readAll(int fd);
+
+public:
+    explicit SourceFile(const std::string &path);
+    ~SourceFile();
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    std::string_view view() const {
+        return std::string_view(data, size);
+    }
+};
@@ -1,6 +1,8 @@
 // tokenizer.cpp : takes raw string and breaks it down into tokens that will be recognized by the parser
 #include <cctype>
 #include <iostream>
+#include <charconv>
+#include <sstream>
 #include "tokenizer.h"
 
 Token Tokenizer::peek() {
@@ -30,18 +32,29 @@ unsigned char Tokenizer::curChar() {
 }
 
 void Tokenizer::failCurrentLine(std::string error_msg) {
-    std::cerr << "At Char: " << curChar() << "\nIn line: \n";
+    // report goes into the exception so callers other than the command line (like the compile server) can show it
+    std::ostringstream report;
 
-    while (curChar() != '\n' && current != 0) current--;
-    current++;
-    while (curChar() != '\n' && curChar() != EOF) {
-        std::cerr << curChar();
+    if (text.empty())
+        current = 0;
+    else if (current >= text.length())
+        current = text.length() - 1;
+
+    if (!text.empty())
+        report << "At Char: " << curChar();
+
+    report << "\nIn line: \n";
+
+    while (current > 0 && curChar() != '\n') current--;
+    if (current < text.length() && curChar() == '\n') current++;
+    while (current < text.length() && curChar() != '\n') {
+        report << curChar();
         current++;
     }
 
-    std::cerr << "\nMessage given: \n" << error_msg << "\n";
+    report << "\nMessage given: \n" << error_msg << "\n";
 
-    throw std::runtime_error("Program failed to parse. See error above.");
+    throw std::runtime_error(report.str() + "Program failed to parse.");
 }
 
 Token Tokenizer::advanceCurrent() {
@@ -103,7 +116,16 @@ Token Tokenizer::advanceCurrent() {
                 while (current < text.length() && std::isdigit(curChar())) current ++;
                 
                 // current now points to the first non-digit character, or past the end of the text
-                return Token{TokenType::NUMBER, atoi(text.substr(start,current).c_str())};
+                int num = 0;
+                auto res = std::from_chars(text.data() + start, text.data() + current, num);
+
+                if (res.ec == std::errc::result_out_of_range) {
+                    auto literal = std::string(text.substr(start, current - start));
+                    current = start;
+                    failCurrentLine("Number literal '" + literal + "' does not fit in an int");
+                }
+
+                return Token{TokenType::NUMBER, num};
             }
 
             // Now down to keywords and identifiers
@@ -114,7 +136,7 @@ Token Tokenizer::advanceCurrent() {
                 while (current < text.length() && std::isalnum(curChar())) { current++; substrlen++; };
                 
                 // current now points to the first non-alphanumeric character, or past the end of the string
-                std::string fragment = text.substr(start, substrlen);
+                std::string_view fragment = text.substr(start, substrlen);
                 
                 // Unlike the constant parsing switch above, this has already advanced current
                 if (fragment == "if") return Token{TokenType::IF};
@@ -131,7 +153,7 @@ Token Tokenizer::advanceCurrent() {
                 else if (fragment == "fields") return Token{TokenType::FIELDS};
                 else if (fragment == "locals") return Token{TokenType::LOCALS};
                 else if (fragment == "null") return Token{TokenType::NUL};
-                else return Token{TokenType::IDENTIFIER, fragment};
+                else return Token{TokenType::IDENTIFIER, std::string(fragment)};
             } else {
                 std::cerr << "Tokenizer caught unsupported character: " << curChar();
             }
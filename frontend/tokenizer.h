@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <optional>
 #include <variant>
 
@@ -53,14 +54,15 @@ struct Token {
 
 class Tokenizer {
 private:
-    std::string text;
+    // view into source owned by the caller, which must outlive the tokenizer
+    std::string_view text;
     
     int current = 0;
     std::optional<Token> cached;
 
 public:
-    explicit Tokenizer(std::string t) :
-        text(std::move(t)) {};
+    explicit Tokenizer(std::string_view t) :
+        text(t) {};
 
     unsigned char curChar();
     void failCurrentLine(std::string error_msg);
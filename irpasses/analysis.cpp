@@ -0,0 +1,211 @@
+// analysis.cpp : liveness, and computing cached analyses on demand
+#include "ir.h"
+#include "passstats.h"
+
+std::string valueKey(const Local &lcl) {
+    // '.' never appears in identifiers, so versions cannot collide with other names
+    if (lcl.version == 0)
+        return lcl.name;
+
+    return lcl.name + '.' + std::to_string(lcl.version);
+}
+
+bool sameValue(const ValPtr &a, const ValPtr &b) {
+    if (a->getValType() != b->getValType())
+        return false;
+
+    if (auto la = dynamic_cast<Local *>(a.get()))
+        return valueKey(*la) == valueKey(static_cast<Local &>(*b));
+
+    if (auto ca = dynamic_cast<Const *>(a.get()))
+        return ca->value == static_cast<Const &>(*b).value;
+
+    return a->getString() == b->getString();
+}
+
+std::optional<long> foldBinary(Oper op, long lhs, long rhs) {
+    // ir441 words are unsigned, arithmetic wraps around and comparisons and division are unsigned
+    auto l = (unsigned long) lhs;
+    auto r = (unsigned long) rhs;
+
+    switch (op) {
+        case Oper::Add: return (long) (l + r);
+        case Oper::Sub: return (long) (l - r);
+        case Oper::Mul: return (long) (l * r);
+        case Oper::Div:
+            if (r == 0)
+                return std::nullopt;
+            return (long) (l / r);
+        case Oper::BitOr: return (long) (l | r);
+        case Oper::BitAnd: return (long) (l & r);
+        case Oper::BitXor: return (long) (l ^ r);
+        case Oper::Eq: return l == r;
+        case Oper::Ne: return l != r;
+        case Oper::Gt: return l > r;
+        case Oper::Lt: return l < r;
+    }
+
+    return std::nullopt;
+}
+
+std::set<std::string> MethodIR::addressValues() const {
+    std::set<std::string> addresses;
+    std::vector<const ValPtr *> work;
+
+    // the values each copy or phi result is taken from
+    std::unordered_map<std::string, std::vector<const ValPtr *>> sources;
+
+    for (auto &block : blocks) {
+        for (auto &phi : block->blockPhi)
+            for (auto &[_, val] : phi->incoming)
+                sources[valueKey(Local(phi->outputVar, phi->resultVersion))].push_back(&val);
+
+        for (auto &inst : block->instructions) {
+            if (auto asn = dynamic_cast<Assign *>(inst.get()); asn && dynamic_cast<Local *>(asn->dest.get()))
+                sources[valueKey(static_cast<Local &>(*asn->dest))].push_back(&asn->src);
+            else if (auto load = dynamic_cast<Load *>(inst.get()))
+                work.push_back(&load->addr);
+            else if (auto store = dynamic_cast<Store *>(inst.get()))
+                work.push_back(&store->addr);
+        }
+    }
+
+    while (!work.empty()) {
+        auto lcl = dynamic_cast<Local *>(work.back()->get());
+        work.pop_back();
+
+        if (!lcl || !addresses.insert(valueKey(*lcl)).second)
+            continue;
+
+        if (auto it = sources.find(valueKey(*lcl)); it != sources.end())
+            work.insert(work.end(), it->second.begin(), it->second.end());
+    }
+
+    return addresses;
+}
+
+static void addUse(const ValPtr &v, const std::set<std::string> &defs, std::set<std::string> &uses) {
+    auto lcl = dynamic_cast<Local *>(v.get());
+
+    if (!lcl)
+        return;
+
+    auto key = valueKey(*lcl);
+
+    // only upward exposed uses make a value live on entry
+    if (!defs.contains(key))
+        uses.insert(key);
+}
+
+void MethodIR::computeLiveness() {
+    requireAnalyses(Predecessors);
+
+    std::map<BasicBlock *, std::set<std::string>> uses;
+    std::map<BasicBlock *, std::set<std::string>> defs;
+
+    for (auto &block : blocks) {
+        auto &use = uses[block.get()];
+        auto &def = defs[block.get()];
+
+        // phi results are defined on entry, their arguments are used on the incoming edges
+        for (auto &phi : block->blockPhi)
+            def.insert(valueKey(Local(phi->outputVar, phi->resultVersion)));
+
+        for (auto &inst : block->instructions) {
+            for (auto op : inst->operands())
+                addUse(*op, def, use);
+
+            if (auto res = inst->result())
+                if (auto lcl = dynamic_cast<Local *>(res->get()))
+                    def.insert(valueKey(*lcl));
+        }
+
+        for (auto op : block->blockTransfer->operands())
+            addUse(*op, def, use);
+
+        block->liveIn.clear();
+        block->liveOut.clear();
+    }
+
+    // backwards dataflow to a fixed point, visiting blocks in reverse creation order converges quickly
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (auto it = blocks.rbegin(); it != blocks.rend(); it++) {
+            auto block = it->get();
+            std::set<std::string> out;
+
+            for (auto succ : block->getNextBlocks()) {
+                for (auto &key : succ->liveIn)
+                    out.insert(key);
+
+                // a phi argument is only live along the edge it comes in on
+                for (auto &phi : succ->blockPhi)
+                    for (auto &[label, val] : phi->incoming)
+                        if (auto lcl = dynamic_cast<Local *>(val.get()); lcl && label == block->label)
+                            out.insert(valueKey(*lcl));
+            }
+
+            std::set<std::string> in = uses[block];
+
+            for (auto &key : out)
+                if (!defs[block].contains(key))
+                    in.insert(key);
+
+            if (in != block->liveIn || out != block->liveOut) {
+                block->liveIn = std::move(in);
+                block->liveOut = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    validAnalyses |= Liveness;
+}
+
+MethodSize MethodIR::measure() const {
+    MethodSize size;
+    size.blocks = blocks.size();
+    size.variables = typedArgs.size() + typedLocals.size() + temps.size();
+
+    for (auto &block : blocks)
+        size.instructions += block->blockPhi.size() + block->instructions.size() + 1;
+
+    return size;
+}
+
+void MethodIR::requireAnalyses(AnalysisSet needed) {
+    auto missing = needed & ~validAnalyses;
+
+    if (missing & Predecessors) {
+        PassTimer timer("predecessors", name);
+        computeBlockPredecessors();
+    }
+
+    if (missing & Dominators) {
+        PassTimer timer("dominators", name);
+        populateDominators();
+    }
+
+    if (missing & DominanceFrontiers) {
+        PassTimer timer("frontiers", name);
+        computeDominanceFrontiers();
+    }
+
+    if (missing & Liveness) {
+        PassTimer timer("liveness", name);
+        computeLiveness();
+    }
+
+    if (missing & DefUses) {
+        PassTimer timer("def-use", name);
+        computeDefUse();
+    }
+
+    if (missing & Loops) {
+        PassTimer timer("loops", name);
+        computeLoops();
+    }
+}
@@ -0,0 +1,180 @@
+// cfgedit.cpp : local CFG edits that patch the analyses they disturb instead of recomputing them
+#include "ir.h"
+
+#include <algorithm>
+
+// deepest block dominating both, found by walking up the tree
+static BasicBlock *commonDominator(BasicBlock *a, BasicBlock *b) {
+    std::set<BasicBlock *> above;
+
+    for (auto runner = a; runner; runner = runner->immediateDominator)
+        above.insert(runner);
+
+    for (auto runner = b; runner; runner = runner->immediateDominator)
+        if (above.contains(runner))
+            return runner;
+
+    return nullptr;
+}
+
+static bool dominates(BasicBlock *a, BasicBlock *b) {
+    for (auto runner = b; runner; runner = runner->immediateDominator)
+        if (runner == a)
+            return true;
+
+    return false;
+}
+
+BasicBlock *MethodIR::splitPredecessors(BasicBlock *block, const std::vector<BasicBlock *> &preds) {
+    auto split = newBasicBlock();
+    split->blockTransfer = std::make_unique<Jump>(block);
+
+    std::set<std::string> labels;
+
+    for (auto pred : preds) {
+        pred->blockTransfer->replaceSuccessor(block, split);
+        labels.insert(pred->label);
+    }
+
+    // arguments arriving from the split predecessors now arrive from the new block, merged there if they differ
+    for (auto &phi : block->blockPhi) {
+        std::vector<std::pair<std::string, ValPtr>> moved;
+
+        std::erase_if(phi->incoming, [&](const std::pair<std::string, ValPtr> &in) {
+            if (!labels.contains(in.first))
+                return false;
+
+            moved.push_back(in);
+            return true;
+        });
+
+        if (moved.empty())
+            continue;
+
+        bool same = std::all_of(moved.begin(), moved.end(), [&](auto &in) { return sameValue(in.second, moved[0].second); });
+
+        if (same) {
+            phi->incoming.push_back({split->label, moved[0].second});
+            continue;
+        }
+
+        auto merge = std::make_unique<Phi>(phi->outputVar);
+        merge->resultVersion = newVersion(phi->outputVar);
+        merge->incoming = std::move(moved);
+
+        phi->incoming.push_back({split->label, std::make_shared<Local>(phi->outputVar, merge->resultVersion)});
+        split->blockPhi.push_back(std::move(merge));
+    }
+
+    if (hasAnalyses(Predecessors)) {
+        for (auto pred : preds) {
+            block->predecessors.erase(pred);
+            split->predecessors.insert(pred);
+        }
+
+        block->predecessors.insert(split);
+    }
+
+    // only the new block and block itself can change dominators, every other path is as it was
+    if (hasAnalyses(Predecessors | Dominators)) {
+        BasicBlock *idom = nullptr;
+
+        for (auto pred : preds)
+            if (pred == getStartBlock() || pred->immediateDominator)
+                idom = idom ? commonDominator(idom, pred) : pred;
+
+        split->immediateDominator = idom;
+        if (idom)
+            idom->domChildren.push_back(split);
+
+        // block now hangs below whatever dominates the new block and the predecessors left that it does not
+        // dominate itself, which is the new block once every way in from outside a loop headed by block is moved
+        if (idom && block != getStartBlock()) {
+            BasicBlock *blockIdom = split;
+
+            for (auto pred : block->predecessors)
+                if (pred != split && (pred == getStartBlock() || pred->immediateDominator) && !dominates(block, pred))
+                    blockIdom = commonDominator(blockIdom, pred);
+
+            if (auto old = block->immediateDominator; old != blockIdom) {
+                if (old)
+                    std::erase(old->domChildren, block);
+
+                block->immediateDominator = blockIdom;
+                blockIdom->domChildren.push_back(block);
+            }
+        }
+    }
+
+    keepAnalyses(Predecessors | Dominators);
+    return split;
+}
+
+void MethodIR::hoistIntoPredecessor(BasicBlock *block) {
+    requireAnalyses(Predecessors);
+
+    auto pred = *block->predecessors.begin();
+    auto succ = block->getNextBlocks()[0];
+
+    pred->instructions.insert(pred->instructions.end(), std::make_move_iterator(block->instructions.begin()),
+        std::make_move_iterator(block->instructions.end()));
+    pred->blockTransfer->replaceSuccessor(block, succ);
+
+    for (auto &phi : succ->blockPhi)
+        for (auto &[label, _] : phi->incoming)
+            if (label == block->label)
+                label = pred->label;
+
+    succ->predecessors.erase(block);
+    succ->predecessors.insert(pred);
+
+    // whatever block dominated is now reached through pred alone just as before
+    if (hasAnalyses(Dominators)) {
+        std::erase(pred->domChildren, block);
+
+        for (auto child : block->domChildren) {
+            child->immediateDominator = pred;
+            pred->domChildren.push_back(child);
+        }
+    }
+
+    std::erase_if(blocks, [&](const std::unique_ptr<BasicBlock> &b) { return b.get() == block; });
+    keepAnalyses(Predecessors | Dominators);
+}
+
+std::vector<std::unique_ptr<BasicBlock>> MethodIR::removeUnreachableBlocks() {
+    std::set<BasicBlock *> reached = {getStartBlock()};
+    std::vector<BasicBlock *> stack = {getStartBlock()};
+
+    while (!stack.empty()) {
+        auto block = stack.back();
+        stack.pop_back();
+
+        for (auto succ : block->getNextBlocks())
+            if (reached.insert(succ).second)
+                stack.push_back(succ);
+    }
+
+    std::vector<std::unique_ptr<BasicBlock>> dropped;
+
+    for (auto &block : blocks) {
+        if (reached.contains(block.get()))
+            continue;
+
+        for (auto succ : block->getNextBlocks()) {
+            if (hasAnalyses(Predecessors))
+                succ->predecessors.erase(block.get());
+
+            for (auto &phi : succ->blockPhi)
+                std::erase_if(phi->incoming, [&](auto &in) { return in.first == block->label; });
+        }
+
+        dropped.push_back(std::move(block));
+    }
+
+    std::erase(blocks, nullptr);
+
+    // unreachable blocks have no dominator and dominate nothing, so the tree stays as it is
+    keepAnalyses(Predecessors | Dominators);
+    return dropped;
+}
@@ -0,0 +1,36 @@
+// copyprop.cpp : replaces uses of copied values with the value copied
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+
+void MethodIR::copyPropagation() {
+    requireAnalyses(DefUses);
+
+    auto stats = PassStats::active();
+
+    // in SSA the source of a copy is defined once and dominates the copy, and so every use of its result
+    for (auto &block : blocks) {
+        std::erase_if(block->instructions, [&](const std::unique_ptr<IROp> &inst) {
+            auto asn = dynamic_cast<Assign *>(inst.get());
+            auto dest = asn ? dynamic_cast<Local *>(asn->dest.get()) : nullptr;
+
+            if (!dest)
+                return false;
+
+            auto key = valueKey(*dest);
+            auto src = dynamic_cast<Local *>(asn->src.get());
+
+            if (src && valueKey(*src) == key)
+                return false;
+
+            defUse.replaceAllUsesWith(key, asn->src);
+            defUse.erase(asn);
+
+            if (stats)
+                stats->copiesPropagated++;
+
+            return true;
+        });
+    }
+}
@@ -0,0 +1,82 @@
+// dce.cpp : removes computations whose results are never used
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+
+// instructions that can be dropped when nothing reads their result
+static bool removable(IROp *inst) {
+    if (dynamic_cast<Assign *>(inst))
+        return true;
+
+    // division by zero panics in the interpreter, so only divisions by known nonzero constants are pure
+    if (auto bin = dynamic_cast<BinInst *>(inst)) {
+        if (bin->op != Oper::Div)
+            return true;
+
+        auto divisor = dynamic_cast<Const *>(bin->rhs.get());
+        return divisor && divisor->value != 0;
+    }
+
+    return false;
+}
+
+void MethodIR::deadCodeElimination() {
+    requireAnalyses(DefUses);
+
+    // each value is marked once and each definition's operands are read once, so this is linear in the method
+    std::set<IROp *> live;
+    std::vector<IROp *> worklist;
+
+    auto markOperands = [&](IROp *inst) {
+        for (auto op : inst->operands())
+            if (auto info = defUse.find(*op); info && info->def && live.insert(info->def).second)
+                worklist.push_back(info->def);
+    };
+
+    // everything with an effect is live, and so is everything it reads
+    for (auto &block : blocks) {
+        for (auto &inst : block->instructions) {
+            auto res = inst->result();
+
+            if (!(res && asLocal(*res) && removable(inst.get())))
+                markOperands(inst.get());
+        }
+
+        for (auto op : block->blockTransfer->operands())
+            if (auto info = defUse.find(*op); info && info->def && live.insert(info->def).second)
+                worklist.push_back(info->def);
+    }
+
+    while (!worklist.empty()) {
+        auto inst = worklist.back();
+        worklist.pop_back();
+        markOperands(inst);
+    }
+
+    auto stats = PassStats::active();
+    size_t removed = 0;
+
+    auto dead = [&](IROp *inst) {
+        if (live.contains(inst))
+            return false;
+
+        defUse.erase(inst);
+        removed++;
+        return true;
+    };
+
+    for (auto &block : blocks) {
+        std::erase_if(block->blockPhi, [&](const std::unique_ptr<Phi> &phi) {
+            return dead(phi.get());
+        });
+
+        std::erase_if(block->instructions, [&](const std::unique_ptr<IROp> &inst) {
+            auto res = inst->result();
+            return res && asLocal(*res) && removable(inst.get()) && dead(inst.get());
+        });
+    }
+
+    if (stats)
+        stats->deadRemoved += removed;
+}
@@ -0,0 +1,149 @@
+// defuse.cpp : def-use chains over SSA values
+#include "ir.h"
+
+// key of the value an instruction or phi defines, empty if it defines none
+static std::string definedKey(IROp *inst) {
+    if (auto phi = dynamic_cast<Phi *>(inst))
+        return valueKey(Local(phi->outputVar, phi->resultVersion));
+
+    auto res = inst->result();
+    auto lcl = res ? asLocal(*res) : nullptr;
+
+    return lcl ? valueKey(*lcl) : "";
+}
+
+void DefUse::addUses(IROp *user, BasicBlock *block, const std::vector<ValPtr *> &slots) {
+    for (auto slot : slots) {
+        auto lcl = asLocal(*slot);
+        if (!lcl)
+            continue;
+
+        auto &sentinel = values[valueKey(*lcl)].uses;
+        auto &use = pool.emplace_back();
+        use.slot = slot;
+        use.user = user;
+        use.block = block;
+
+        use.prev = sentinel.prev;
+        use.next = &sentinel;
+        sentinel.prev->next = &use;
+        sentinel.prev = &use;
+
+        if (user)
+            byUser[user].push_back(&use);
+    }
+}
+
+void DefUse::build(MethodIR &method) {
+    values.clear();
+    pool.clear();
+    byUser.clear();
+
+    auto define = [&](IROp *inst, BasicBlock *block) {
+        auto key = definedKey(inst);
+        if (key.empty())
+            return;
+
+        auto &info = values[key];
+        info.def = inst;
+        info.defBlock = block;
+    };
+
+    for (auto &block : method.blocks) {
+        for (auto &phi : block->blockPhi) {
+            define(phi.get(), block.get());
+            addUses(phi.get(), block.get(), phi->operands());
+        }
+
+        for (auto &inst : block->instructions) {
+            define(inst.get(), block.get());
+            addUses(inst.get(), block.get(), inst->operands());
+        }
+
+        addUses(nullptr, block.get(), block->blockTransfer->operands());
+    }
+}
+
+DefUse::Info *DefUse::find(const std::string &key) {
+    auto it = values.find(key);
+    return it == values.end() ? nullptr : &it->second;
+}
+
+DefUse::Info *DefUse::find(const ValPtr &v) {
+    auto lcl = asLocal(v);
+    return lcl ? find(valueKey(*lcl)) : nullptr;
+}
+
+size_t DefUse::useCount(const std::string &key) {
+    auto info = find(key);
+    size_t count = 0;
+
+    if (info)
+        info->forEachUse([&](Use &) { count++; });
+
+    return count;
+}
+
+void DefUse::replaceAllUsesWith(const std::string &key, const ValPtr &replacement) {
+    auto info = find(key);
+    if (!info)
+        return;
+
+    // the replacement may live in a slot that is about to be rewritten
+    ValPtr value = replacement;
+
+    if (info->unused())
+        return;
+
+    info->forEachUse([&](Use &use) { *use.slot = value; });
+
+    // constants and globals have no chains to join
+    auto lcl = asLocal(value);
+    if (!lcl) {
+        info->forEachUse([](Use &use) { use.unlink(); });
+        return;
+    }
+
+    auto newKey = valueKey(*lcl);
+    if (newKey == key)
+        return;
+
+    // elements of an unordered_map stay put when it grows, so info is still valid
+    auto &target = values[newKey].uses;
+    auto first = info->uses.next;
+    auto last = info->uses.prev;
+
+    info->uses.next = info->uses.prev = &info->uses;
+
+    first->prev = target.prev;
+    last->next = &target;
+    target.prev->next = first;
+    target.prev = last;
+}
+
+void DefUse::erase(IROp *inst) {
+    if (auto it = byUser.find(inst); it != byUser.end()) {
+        for (auto use : it->second)
+            use->unlink();
+
+        byUser.erase(it);
+    }
+
+    auto key = definedKey(inst);
+    auto info = key.empty() ? nullptr : find(key);
+
+    if (!info || info->def != inst)
+        return;
+
+    if (info->unused())
+        values.erase(key);
+    else {
+        info->def = nullptr;
+        info->defBlock = nullptr;
+    }
+}
+
+void MethodIR::computeDefUse() {
+    defUse.build(*this);
+    validAnalyses |= DefUses;
+}
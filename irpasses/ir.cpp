@@ -1,11 +1,11 @@
 #include "ir.h"
-#include <iostream>
+#include "passstats.h"
+
+void Local::outputIR(IRWriter &out) const {
+    out << '%' << name;
 
-void Local::outputIR() const {
     if (version)
-        std::cout << "%" << name << 'v' << version;
-    else 
-        std::cout << "%" << name;
+        out << 'v' << version;
 }
 
 std::string Local::getString() const {
@@ -16,8 +16,8 @@ ValType Local::getValType() const {
     return ValType::VarType;
 }
 
-void Global::outputIR() const {
-    std::cout << "@" << name;
+void Global::outputIR(IRWriter &out) const {
+    out << '@' << name;
 }
 
 std::string Global::getString() const {
@@ -29,8 +29,8 @@ ValType Global::getValType() const {
 }
 
 // only tag from ir generation
-void Const::outputIR() const {
-    std::cout << value;
+void Const::outputIR(IRWriter &out) const {
+    out << value;
 }
 
 std::string Const::getString() const {
@@ -41,170 +41,169 @@ ValType Const::getValType() const {
     return ValType::ConstType;
 }
 
-void Assign::outputIR() const {
-    dest->outputIR();
-    std::cout << " = ";
-    src->outputIR();
+void Assign::outputIR(IRWriter &out) const {
+    dest->outputIR(out);
+    out << " = ";
+    src->outputIR(out);
 }
 
-void BinInst::outputIR() const {
-    dest->outputIR();
-    std::cout << " = ";
-    lhs->outputIR();
+void BinInst::outputIR(IRWriter &out) const {
+    dest->outputIR(out);
+    out << " = ";
+    lhs->outputIR(out);
     
     switch(op) {
         case Oper::Add:
-            std::cout << " +";
+            out << " +";
             break;
         case Oper::BitAnd:
-            std::cout << " &";
+            out << " &";
             break;
         case Oper::BitOr:
-            std::cout << " |";
+            out << " |";
             break;
         case Oper::BitXor:
-            std::cout << " ^";
+            out << " ^";
             break;
         case Oper::Div:    
-            std::cout << " /";
+            out << " /";
             break;
         case Oper::Eq:
-            std::cout << " ==";
+            out << " ==";
             break;
         case Oper::Gt:
-            std::cout << " >";
+            out << " >";
             break;
         case Oper::Lt:
-            std::cout << " <";
+            out << " <";
             break;
         case Oper::Mul:
-            std::cout << " *";
+            out << " *";
             break;
         case Oper::Ne:
-            std::cout << " !=";
+            out << " !=";
             break;
         case Oper::Sub:
-            std::cout << " -";
+            out << " -";
             break;
     }
 
-    std::cout << " ";
-    rhs->outputIR();
+    out << " ";
+    rhs->outputIR(out);
 }
 
-void Call::outputIR() const {
-    dest->outputIR();
+void Call::outputIR(IRWriter &out) const {
+    dest->outputIR(out);
 
-    std::cout << " = call(";
+    out << " = call(";
 
-    code->outputIR();
+    code->outputIR(out);
 
     for (const auto& arg : args) {
-        std::cout << ", ";
-        arg->outputIR();
+        out << ", ";
+        arg->outputIR(out);
     }
 
-    std::cout << ")";
+    out << ")";
 }
 
-void Phi::outputIR() const {
-    Local(outputVar, resultVersion).outputIR();
+void Phi::outputIR(IRWriter &out) const {
+    Local(outputVar, resultVersion).outputIR(out);
 
-    std::cout << " = phi(";
+    out << " = phi(";
 
     bool first = true;
-    for (auto& [inblock, version] : incoming) {
+    for (auto& [inblock, val] : incoming) {
         if (first)
             first = false;
         else
-            std::cout << ", ";
+            out << ", ";
+
+        out << inblock;
+        out << ", ";
 
-        std::cout << inblock;
-        std::cout << ", ";
-        
-        // output local with 
-        Local(outputVar, version).outputIR();
+        val->outputIR(out);
     }
 
-    std::cout << ")";
+    out << ")";
 }
 
-void Alloc::outputIR() const {
-    dest->outputIR();
+void Alloc::outputIR(IRWriter &out) const {
+    dest->outputIR(out);
     
-    std::cout << " = ";
-    std::cout << "alloc(" << numSlots << ")";
+    out << " = ";
+    out << "alloc(" << numSlots << ")";
 }
 
-void Print::outputIR() const {
-    std::cout << "print(";
-    val->outputIR();
-    std::cout << ")";
+void Print::outputIR(IRWriter &out) const {
+    out << "print(";
+    val->outputIR(out);
+    out << ")";
 }
 
-void GetElt::outputIR() const {
-    dest->outputIR();
-    std::cout << " = getelt(";
-    array->outputIR();
-    std::cout << ", ";
-    index->outputIR();
-    std::cout << ")";
+void GetElt::outputIR(IRWriter &out) const {
+    dest->outputIR(out);
+    out << " = getelt(";
+    array->outputIR(out);
+    out << ", ";
+    index->outputIR(out);
+    out << ")";
 }
 
-void SetElt::outputIR() const {
-    std::cout << "setelt(";
-    array->outputIR();
-    std::cout << ", ";
-    index->outputIR();
-    std::cout << ", ";
-    val->outputIR();
-    std::cout << ")";
+void SetElt::outputIR(IRWriter &out) const {
+    out << "setelt(";
+    array->outputIR(out);
+    out << ", ";
+    index->outputIR(out);
+    out << ", ";
+    val->outputIR(out);
+    out << ")";
 }
 
-void Load::outputIR() const {
-    dest->outputIR();
-    std::cout << " = load(";
-    addr->outputIR();
-    std::cout << ")";
+void Load::outputIR(IRWriter &out) const {
+    dest->outputIR(out);
+    out << " = load(";
+    addr->outputIR(out);
+    out << ")";
 }
 
-void Store::outputIR() const {
-    std::cout << "store(";
-    addr->outputIR();
-    std::cout << ", ";
-    val->outputIR();
-    std::cout << ")";
+void Store::outputIR(IRWriter &out) const {
+    out << "store(";
+    addr->outputIR(out);
+    out << ", ";
+    val->outputIR(out);
+    out << ")";
 }
 
-void Jump::outputIR() const {
-    std::cout << "jump " << target->label;
+void Jump::outputIR(IRWriter &out) const {
+    out << "jump " << target->label;
 }
 
-void Conditional::outputIR() const {
-    std::cout << "if ";
-    condition->outputIR();
-    std::cout << " then " << trueTarget->label << " else " << falseTarget->label;
+void Conditional::outputIR(IRWriter &out) const {
+    out << "if ";
+    condition->outputIR(out);
+    out << " then " << trueTarget->label << " else " << falseTarget->label;
 }
 
-void Return::outputIR() const {
-    std::cout << "ret ";
-    val->outputIR();
+void Return::outputIR(IRWriter &out) const {
+    out << "ret ";
+    val->outputIR(out);
 }
 
-void Fail::outputIR() const {
-    std::cout << "fail ";
+void Fail::outputIR(IRWriter &out) const {
+    out << "fail ";
     switch (reason) {
         case FailReason::NotANumber:
-            std::cout << "NotANumber";
+            out << "NotANumber";
             break;
         case FailReason::NotAPointer:
-            std::cout << "NotAPointer";
+            out << "NotAPointer";
             break;
         case FailReason::NoSuchField:
-            std::cout << "NoSuchField";
+            out << "NoSuchField";
             break;
         case FailReason::NoSuchMethod:
-            std::cout << "NoSuchMethod";
+            out << "NoSuchMethod";
             break;
     }
 }
@@ -213,43 +212,53 @@ void Fail::outputIR() const {
 HangingBlock::~HangingBlock() = default;
 
 // return 0 by default from methods that are hanging
-void HangingBlock::outputIR() const {
-    std::cout << "ret 0";
+void HangingBlock::outputIR(IRWriter &out) const {
+    out << "ret 0";
 }
 
-void ClassMetadata::outputIR() const {
-    std::cout << "global array " << VTABLE(name).getString();
-    std::cout << ": { ";
+void ClassMetadata::outputIR(IRWriter &out) const {
+    out << "global array " << VTABLE(name).getString();
+    out << ": { ";
     
     for (size_t i = 0; i < vtable.size(); ++i) {
-        if (i) std::cout << ", ";
-        std::cout << vtable[i];
+        if (i) out << ", ";
+        out << vtable[i];
     }
     
-    std::cout << " }\n";
+    out << " }\n";
 }
 
-void BasicBlock::outputIR() const {
-    std::cout << label << ":\n";
+void BasicBlock::outputIR(IRWriter &out) const {
+    out << label << ":\n";
 
     for (const auto& inst: blockPhi) {
-        std::cout << "\t";
-        inst->outputIR();
-        std::cout << "\n";
+        out << '\t';
+        inst->outputIR(out);
+        out << '\n';
     }
 
     for (const auto& inst : instructions) {
-        std::cout << "\t";
-        inst->outputIR();
-        std::cout << "\n";
+        out << '\t';
+        inst->outputIR(out);
+        out << '\n';
     }
 
-    std::cout << "\t";
-    blockTransfer->outputIR();
-    std::cout << "\n";
+    out << '\t';
+    blockTransfer->outputIR(out);
+    out << '\n';
 }
 
-void MethodIR::outputIR() const {
+void MethodIR::outputIR(IRWriter &out) const {
+    PassTimer timer("emit", name);
+
+    if (auto stats = PassStats::active()) {
+        stats->blocks += blocks.size();
+
+        // every block ends in exactly one control transfer
+        for (const auto& block : blocks)
+            stats->instructions += block->instructions.size() + 1;
+    }
+
     // replace first block label with one that has arguments
     if (typedArgs.size() > 0) {
         auto newlbl = name;
@@ -266,25 +275,29 @@ void MethodIR::outputIR() const {
     }
 
     for (const auto& block : blocks) {
-        block->outputIR();
+        block->outputIR(out);
     }
 
-    std::cout << "\n";
+    out << "\n";
 }
 
-void CFG::outputIR() const {
-    std::cout << "data:\n";
+void CFG::outputData(IRWriter &out) const {
+    out << "data:\n";
 
     for (const auto& [_, cls] : classinfo)
-        cls->outputIR();
+        cls->outputIR(out);
+
+    out << "\ncode:\n\n";
+}
 
-    std::cout << "\ncode:\n\n";
+void CFG::outputIR(IRWriter &out) const {
+    outputData(out);
 
     for (const auto& [_, method] : methodinfo) {
-        method->outputIR();
+        method->outputIR(out);
     }
     
-    std::cout << "\n";
+    out << "\n";
 }
 
 // Add these to prevent linker errors! None should be called! Ever!
@@ -292,10 +305,10 @@ void CFG::outputIR() const {
 Value::~Value() = default;
 ControlTransfer::~ControlTransfer() = default;
 
-void Value::outputIR() const {
+void Value::outputIR(IRWriter &out) const {
     return;
 }
 
-void ControlTransfer::outputIR() const {
+void ControlTransfer::outputIR(IRWriter &out) const {
     return;
 }
@@ -5,6 +5,11 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <optional>
+#include <deque>
+#include <unordered_map>
+
+#include "irwriter.h"
 
 enum TagType { Pointer = 0, Integer = 1 };
 enum ValType { VarType = 0, ConstType = 1, GlobalType = 2};
@@ -13,7 +18,7 @@ struct Value {
     bool ignoreSSA;
 
     virtual ~Value();
-    virtual void outputIR() const = 0;
+    virtual void outputIR(IRWriter &out) const = 0;
     virtual std::string getString() const = 0;
     virtual ValType getValType() const = 0;
     virtual int hash() const = 0;
@@ -30,7 +35,7 @@ struct Local : Value {
             ignoreSSA = tempVal;
         }
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
     std::string getString() const override;
     ValType getValType() const override;
     int hash() const override;
@@ -46,7 +51,7 @@ struct Global : Value {
             ignoreSSA = true;
         }
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
     std::string getString() const override;
     ValType getValType() const override;
     int hash() const override;
@@ -60,7 +65,7 @@ struct Const : Value {
         value = v;
     }
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
     std::string getString() const override;
     ValType getValType() const override;
     int hash() const override;
@@ -74,16 +79,40 @@ enum class Oper {
 
 struct IROp {
     virtual ~IROp() = default;
-    virtual void outputIR() const = 0;
+    virtual void outputIR(IRWriter &out) const = 0;
     virtual std::set<ValPtr *> varsUsed() = 0;
     virtual std::set<ValPtr *> varsDef() = 0;
+
+    // every value read, temporaries and constants included, unlike varsUsed which only covers renamed variables
+    virtual std::vector<ValPtr *> operands() = 0;
+
+    // value written by the instruction, if any
+    virtual ValPtr *result() { return nullptr; }
+
+    // copy reading and writing the same values, for passes that duplicate code
+    virtual std::unique_ptr<IROp> clone() const = 0;
 };
 
+// non-null entries of a list of operand slots
+inline std::vector<ValPtr *> presentOperands(std::initializer_list<ValPtr *> slots) {
+    std::vector<ValPtr *> ret;
+
+    for (auto slot : slots)
+        if (*slot)
+            ret.push_back(slot);
+
+    return ret;
+}
+
 struct Assign : IROp {
     ValPtr dest;
     ValPtr src;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Assign>(*this);
+    }
 
     Assign(ValPtr d, ValPtr s): 
         dest(d), src(std::move(s)) {}
@@ -105,6 +134,14 @@ struct Assign : IROp {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&src});
+    }
+
+    ValPtr *result() override {
+        return &dest;
+    }
 };
 
 struct BinInst : IROp {
@@ -113,7 +150,12 @@ struct BinInst : IROp {
     ValPtr lhs;
     ValPtr rhs;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<BinInst>(*this);
+    }
+
     int hash(int lhsVN, int rhsVN) const;
 
     BinInst(ValPtr d, Oper o, ValPtr l, ValPtr r): 
@@ -139,6 +181,14 @@ struct BinInst : IROp {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&lhs, &rhs});
+    }
+
+    ValPtr *result() override {
+        return &dest;
+    }
 };
 
 struct Call : IROp {
@@ -146,7 +196,11 @@ struct Call : IROp {
     ValPtr code;
     std::vector<ValPtr> args;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Call>(*this);
+    }
     
     Call(ValPtr d, ValPtr c, std::vector<ValPtr> a): 
         dest(d), code(std::move(c)), args(std::move(a)) {}
@@ -172,14 +226,34 @@ struct Call : IROp {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        auto ret = presentOperands({&code});
+
+        for (auto& arg : args)
+            if (arg)
+                ret.push_back(&arg);
+
+        return ret;
+    }
+
+    ValPtr *result() override {
+        return &dest;
+    }
 };
 
 struct Phi : IROp {
     std::string outputVar;
     int resultVersion;
-    std::vector<std::pair<std::string, int>> incoming;
 
-    void outputIR() const override;
+    // value flowing in from each predecessor label, a version of outputVar until passes rewrite it
+    std::vector<std::pair<std::string, ValPtr>> incoming;
+
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Phi>(*this);
+    }
     
     explicit Phi(std::string varname): 
         outputVar(varname) {}
@@ -192,13 +266,26 @@ struct Phi : IROp {
     std::set<ValPtr *> varsDef() {
         return {};
     }
+
+    std::vector<ValPtr *> operands() override {
+        std::vector<ValPtr *> ret;
+
+        for (auto &[_, val] : incoming)
+            ret.push_back(&val);
+
+        return ret;
+    }
 };
 
 struct Alloc : IROp {
     ValPtr dest;
     int numSlots;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Alloc>(*this);
+    }
     
     Alloc(ValPtr d, int n): 
         dest(d), numSlots(n) {}
@@ -215,12 +302,24 @@ struct Alloc : IROp {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        return {};
+    }
+
+    ValPtr *result() override {
+        return &dest;
+    }
 };
 
 struct Print : IROp {
     ValPtr val;
     
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Print>(*this);
+    }
     
     explicit Print(ValPtr v): 
         val(std::move(v)) {}
@@ -237,6 +336,10 @@ struct Print : IROp {
     std::set<ValPtr *> varsDef() {
         return {};
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&val});
+    }
 };
 
 struct GetElt : IROp {
@@ -244,7 +347,11 @@ struct GetElt : IROp {
     ValPtr array;
     ValPtr index;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<GetElt>(*this);
+    }
     
     GetElt(ValPtr d, ValPtr a, ValPtr i): 
         dest(d), array(std::move(a)), index(std::move(i)) {}
@@ -269,6 +376,14 @@ struct GetElt : IROp {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&array, &index});
+    }
+
+    ValPtr *result() override {
+        return &dest;
+    }
 };
 
 struct SetElt : IROp {
@@ -276,7 +391,11 @@ struct SetElt : IROp {
     ValPtr index;
     ValPtr val;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<SetElt>(*this);
+    }
     
     SetElt(ValPtr a, ValPtr i, ValPtr v): 
            array(std::move(a)), index(std::move(i)), val(std::move(v)) {}
@@ -299,13 +418,21 @@ struct SetElt : IROp {
     std::set<ValPtr *> varsDef() {
         return {};
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&array, &index, &val});
+    }
 };
 
 struct Load : IROp {
     ValPtr dest;
     ValPtr addr;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Load>(*this);
+    }
     
     Load(ValPtr d, ValPtr addy): 
         dest(d), addr(std::move(addy)) {}
@@ -327,13 +454,25 @@ struct Load : IROp {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&addr});
+    }
+
+    ValPtr *result() override {
+        return &dest;
+    }
 };
 
 struct Store : IROp {
     ValPtr addr;
     ValPtr val;
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<IROp> clone() const override {
+        return std::make_unique<Store>(*this);
+    }
     
     Store(ValPtr addy, ValPtr v): 
         addr(std::move(addy)), val(std::move(v)) {}
@@ -353,15 +492,26 @@ struct Store : IROp {
     std::set<ValPtr *> varsDef() {
         return {};
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&addr, &val});
+    }
 };
 
 struct BasicBlock;
 
 struct ControlTransfer {
     virtual ~ControlTransfer();
-    virtual void outputIR() const;
+    virtual void outputIR(IRWriter &out) const;
     virtual std::vector<BasicBlock*> successors() const = 0;
     virtual std::set<ValPtr *> varsUsed() = 0;
+    virtual std::vector<ValPtr *> operands() { return {}; }
+
+    // point every edge to from at to instead
+    virtual void replaceSuccessor(BasicBlock *from, BasicBlock *to) = 0;
+
+    // copy with the same successors and operands
+    virtual std::unique_ptr<ControlTransfer> clone() const = 0;
 };
 
 struct Jump : ControlTransfer {
@@ -369,12 +519,21 @@ struct Jump : ControlTransfer {
 
     explicit Jump(BasicBlock *t) : target(t) {}
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<ControlTransfer> clone() const override {
+        return std::make_unique<Jump>(*this);
+    }
     
     std::vector<BasicBlock *> successors() const override {
         return {target};
     }
 
+    void replaceSuccessor(BasicBlock *from, BasicBlock *to) override {
+        if (target == from)
+            target = to;
+    }
+
     std::set<ValPtr *> varsUsed() {
         return {};
     }
@@ -388,12 +547,23 @@ struct Conditional : ControlTransfer {
     Conditional(ValPtr cond, BasicBlock *t, BasicBlock *f): 
         condition(std::move(cond)), trueTarget(t), falseTarget(f) {}
 
-    void outputIR() const override;
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<ControlTransfer> clone() const override {
+        return std::make_unique<Conditional>(*this);
+    }
     
     std::vector<BasicBlock *> successors() const override {
         return {trueTarget, falseTarget};
     }
 
+    void replaceSuccessor(BasicBlock *from, BasicBlock *to) override {
+        if (trueTarget == from)
+            trueTarget = to;
+        if (falseTarget == from)
+            falseTarget = to;
+    }
+
     std::set<ValPtr *> varsUsed() {
         std::set<ValPtr *> ret;
 
@@ -402,6 +572,10 @@ struct Conditional : ControlTransfer {
 
         return ret;
     }
+
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&condition});
+    }
 };
 
 struct Return : ControlTransfer {
@@ -411,7 +585,14 @@ struct Return : ControlTransfer {
         return {};
     }
 
-    void outputIR() const override;
+    // no successors to replace
+    void replaceSuccessor(BasicBlock *, BasicBlock *) override {}
+
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<ControlTransfer> clone() const override {
+        return std::make_unique<Return>(*this);
+    }
 
     std::set<ValPtr *> varsUsed() {
         std::set<ValPtr *> ret;
@@ -422,6 +603,10 @@ struct Return : ControlTransfer {
         return ret;
     }
 
+    std::vector<ValPtr *> operands() override {
+        return presentOperands({&val});
+    }
+
     explicit Return(ValPtr v): 
         val(std::move(v)) {}
 };
@@ -431,7 +616,13 @@ struct HangingBlock : ControlTransfer {
         return {};
     }
 
-    void outputIR() const override;
+    void replaceSuccessor(BasicBlock *, BasicBlock *) override {}
+
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<ControlTransfer> clone() const override {
+        return std::make_unique<HangingBlock>(*this);
+    }
 
     virtual ~HangingBlock();
     HangingBlock() {}
@@ -455,7 +646,13 @@ struct Fail : ControlTransfer {
         return {};
     }
 
-    void outputIR() const override;
+    void replaceSuccessor(BasicBlock *, BasicBlock *) override {}
+
+    void outputIR(IRWriter &out) const override;
+
+    std::unique_ptr<ControlTransfer> clone() const override {
+        return std::make_unique<Fail>(*this);
+    }
 
     explicit Fail(FailReason r): 
         reason(r) {}
@@ -463,27 +660,78 @@ struct Fail : ControlTransfer {
     std::set<ValPtr *> varsUsed() {return {};}
 };
 
+// analyses whose results are stored on a method's blocks
+// passes declare which they need and which survive them, see passmanager.h
+enum Analysis : unsigned {
+    Predecessors = 1 << 0,
+
+    // immediate dominators and the dominator tree, patched in place by the CFG edits below
+    Dominators = 1 << 1,
+
+    // recomputed from the dominator tree after the CFG changes
+    DominanceFrontiers = 1 << 4,
+
+    // variables live into and out of every block
+    Liveness = 1 << 2,
+
+    // the method's DefUse index, only meaningful in SSA form
+    DefUses = 1 << 3,
+
+    // natural loops with their induction variables and trip counts, which read instructions as well as the CFG
+    Loops = 1 << 5,
+
+    // everything that depends only on the shape of the CFG, kept by passes that leave it alone
+    CFGAnalyses = Predecessors | Dominators | DominanceFrontiers,
+
+    AllAnalyses = CFGAnalyses | Liveness | DefUses | Loops
+};
+
+using AnalysisSet = unsigned;
+
+// name a local is tracked under by liveness and dead code elimination, distinct for every SSA version
+std::string valueKey(const Local &lcl);
+
+// whether two operands always hold the same value, by key, constant value or global name
+bool sameValue(const ValPtr &a, const ValPtr &b);
+
+// the operand as a local or a constant, null if it is something else
+inline Local *asLocal(const ValPtr &v) { return dynamic_cast<Local *>(v.get()); }
+inline Const *asConst(const ValPtr &v) { return dynamic_cast<Const *>(v.get()); }
+
+// result of a binary operation on constants as the interpreter computes it, empty where it would panic
+std::optional<long> foldBinary(Oper op, long lhs, long rhs);
+
 struct BasicBlock {
     std::vector<std::unique_ptr<Phi>> blockPhi;
     std::vector<std::unique_ptr<IROp>> instructions;
     std::unique_ptr<ControlTransfer> blockTransfer;
     std::string label;
     
-    BasicBlock *immediateDominator;
+    // null for the start block and blocks it cannot reach
+    BasicBlock *immediateDominator = nullptr;
     std::set<BasicBlock *> predecessors;
-    std::set<BasicBlock *> dominators;
-    std::set<BasicBlock *> domChildren;
+
+    // in block order, so walks of the tree are deterministic
+    std::vector<BasicBlock *> domChildren;
     std::set<BasicBlock *> dominancefront;
 
+    std::set<std::string> liveIn;
+    std::set<std::string> liveOut;
+
     ~BasicBlock() = default;
 
-    void outputIR() const;
-    void valueNumberingPass();
+    void outputIR(IRWriter &out) const;
+
+    // addresses are the method's, see MethodIR::addressValues
+    void valueNumberingPass(const std::set<std::string> &addresses);
     void convertSSA();
     void renameVars(std::map<std::string,int> &counter, std::map<std::string,std::vector<int>> &stack);
     std::vector<BasicBlock *> getNextBlocks() {
         return blockTransfer->successors();
     }
+
+    // walks up the dominator tree, so costs the depth of this block in it
+    bool dominatedBy(const BasicBlock *other) const;
     
     BasicBlock(std::string lbl): label(std::move(lbl)) {
             // Basic Block has a hanging end while instantiating
@@ -492,6 +740,179 @@ struct BasicBlock {
         } 
 };
 
+class MethodIR;
+
+// Def-use chains of a method in SSA form
+// every value, keyed by valueKey, knows the phi or instruction defining it and every operand slot reading it,
+// so passes can count and rewrite uses without rescanning the method
+class DefUse {
+public:
+    // one operand slot, linked into the use list of the value it reads
+    struct Use {
+        ValPtr *slot = nullptr;
+
+        // null when the use is in the block's control transfer
+        IROp *user = nullptr;
+        BasicBlock *block = nullptr;
+
+        Use *prev = this;
+        Use *next = this;
+
+        void unlink() {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+    };
+
+    struct Info {
+        // null for arguments and "this", which are defined on entry
+        IROp *def = nullptr;
+        BasicBlock *defBlock = nullptr;
+
+        // circular list through this sentinel, so a use unlinks itself and whole lists splice in constant time
+        Use uses;
+
+        Info() = default;
+        Info(const Info &) = delete;
+
+        bool unused() const { return uses.next == &uses; }
+
+        template <typename F>
+        void forEachUse(F f) {
+            for (auto use = uses.next; use != &uses;) {
+                auto next = use->next;
+                f(*use);
+                use = next;
+            }
+        }
+    };
+
+private:
+    // map nodes never move, so sentinels stay where uses point
+    std::unordered_map<std::string, Info> values;
+
+    std::deque<Use> pool;
+    std::unordered_map<IROp *, std::vector<Use *>> byUser;
+
+    void addUses(IROp *user, BasicBlock *block, const std::vector<ValPtr *> &slots);
+
+public:
+    void build(MethodIR &method);
+
+    // null for constants, globals and keys never seen
+    Info *find(const std::string &key);
+    Info *find(const ValPtr &v);
+
+    size_t useCount(const std::string &key);
+
+    // point every use of key at replacement and hand the uses over to it
+    // each slot is rewritten once, and moving the use list is a constant time splice
+    void replaceAllUsesWith(const std::string &key, const ValPtr &replacement);
+
+    // drop the uses and definition of an instruction about to be deleted from its block, in time linear in its operands
+    void erase(IROp *inst);
+};
+
+// A value of a loop that changes by the same amount on every iteration
+// Basic ones are header phis that every back edge brings a constant step further. Derived ones are
+// basis * scale + offset for a basic one, computed by additions and multiplications by constants in the loop.
+// All arithmetic wraps like the interpreter's, so subtracting k is scaling or offsetting by -k.
+struct Induction {
+    ValPtr value;
+
+    // index of the basic induction variable in the loop's list, its own for basic ones
+    size_t basis = 0;
+    unsigned long scale = 1;
+    unsigned long offset = 0;
+
+    // change per iteration, the basis step times scale for derived ones
+    unsigned long step = 0;
+
+    // basic ones only: the value on entry when every way in brings the same one, and the value back edges bring
+    ValPtr start;
+    ValPtr next;
+
+    bool isBasic() const { return next != nullptr; }
+};
+
+// How many times a loop's header runs each time the loop is entered
+// On the k-th run the exit test compares start + offset + k * step against a limit that does not change in the loop,
+// leaving once the tested value is no longer below it, no longer above it, or equal to it
+struct TripCount {
+    enum Kind { Below, Above, Until };
+
+    Kind kind;
+    ValPtr start;
+    unsigned long offset;
+    unsigned long step;
+    ValPtr limit;
+
+    // when start and limit are constants
+    std::optional<unsigned long> constant = std::nullopt;
+};
+
+struct Loop {
+    BasicBlock *header = nullptr;
+    Loop *parent = nullptr;
+    std::vector<Loop *> children;
+
+    // 1 for loops no other loop contains
+    int depth = 1;
+
+    // in block order with the header first, including the blocks of nested loops
+    std::vector<BasicBlock *> blocks;
+
+    // predecessors of the header inside the loop, and blocks inside with a successor outside
+    std::vector<BasicBlock *> latches;
+    std::vector<BasicBlock *> exiting;
+
+    // the phi or instruction defining each value inside the loop, by key, with its block
+    std::unordered_map<std::string, std::pair<IROp *, BasicBlock *>> definitions;
+
+    // phis, instructions and terminators of every block, what one copy of the body costs
+    size_t size = 0;
+
+    std::vector<Induction> inductions;
+    std::optional<TripCount> tripCount;
+
+    bool contains(const BasicBlock *block) const { return members.contains(block); }
+
+    // the induction variable v is, or null
+    const Induction *induction(const ValPtr &v) const;
+
+private:
+    std::set<const BasicBlock *> members;
+    friend class LoopForest;
+};
+
+// Natural loops of a method: one per block entered by a back edge, made of the blocks that reach a back edge
+// without passing through the header. Loops with different headers are nested or disjoint, so they form a forest.
+class LoopForest {
+    // deque elements never move, so loops can point at each other
+    std::deque<Loop> loops;
+    std::vector<Loop *> nested;
+    std::unordered_map<const BasicBlock *, Loop *> innermost;
+
+public:
+    void build(MethodIR &method);
+
+    // every loop after the loops containing it, reverse it to visit inner loops first
+    const std::vector<Loop *> &all() const { return nested; }
+
+    // innermost loop containing block, or null
+    Loop *loopFor(const BasicBlock *block) const;
+};
+
+// size metrics that decide how much optimization a method can afford
+struct MethodSize {
+    size_t blocks = 0;
+    size_t instructions = 0;
+
+    // arguments, locals and temporaries
+    size_t variables = 0;
+};
+
 class MethodIR {
     std::string name;
     std::vector<std::pair<std::string, std::string>> typedLocals;
@@ -500,6 +921,15 @@ class MethodIR {
 
     int lastblknum = 0;
 
+    // analyses currently up to date on the blocks
+    AnalysisSet validAnalyses = 0;
+
+    // highest SSA version of every variable, so later passes can create new ones
+    std::map<std::string, int> ssaVersions;
+
+    DefUse defUse;
+    LoopForest loops;
+
 public:
     std::vector<std::unique_ptr<BasicBlock>> blocks;
 
@@ -532,14 +962,104 @@ public:
         return temps;
     }
 
-    void outputIR() const;
+    const std::string &getName() const {
+        return name;
+    }
+
+    MethodSize measure() const;
+
+    void outputIR(IRWriter &out) const;
     void computeBlockPredecessors();
     void populateDominators();
-    void convertSSA();
+    void computeDominanceFrontiers();
+    void computeLiveness();
+    void computeDefUse();
+
+    // values read as the address of a load or store, and the copies and phis they reach one through
+    // these point inside an object, which a call or an allocation can let the collector move without updating them
+    std::set<std::string> addressValues() const;
+
+    // def-use chains, valid while passes that change the method keep them up to date
+    DefUse &getDefUse() { return defUse; }
+
+    void computeLoops();
+    LoopForest &getLoops() { return loops; }
+
+    // compute every analysis in the set that is not already valid
+    void requireAnalyses(AnalysisSet needed);
+
+    // forget every analysis not in the set, called after a pass changed the method
+    void keepAnalyses(AnalysisSet preserved) { validAnalyses &= preserved; }
+
+    bool hasAnalyses(AnalysisSet analyses) const { return (validAnalyses & analyses) == analyses; }
+
+    // Local CFG edits that keep predecessors and the dominator tree valid instead of forcing a recompute
+    // Dominance frontiers, liveness and def-use chains are dropped, phis in the successor are rewired
+
+    // new block between some predecessors of block and block itself, taking over their phi arguments
+    BasicBlock *splitPredecessors(BasicBlock *block, const std::vector<BasicBlock *> &preds);
+    BasicBlock *splitEdge(BasicBlock *from, BasicBlock *to) { return splitPredecessors(to, {from}); }
+
+    // move the instructions of a block with one predecessor and a jump to the end of that predecessor, and delete it
+    // the caller makes sure they are safe to run on the predecessor's other edges, which must not lead to the same block
+    void hoistIntoPredecessor(BasicBlock *block);
+
+    // drop the blocks the start block no longer reaches, with the phi arguments they pass to reachable ones, and
+    // hand them back so the caller can tell which went
+    std::vector<std::unique_ptr<BasicBlock>> removeUnreachableBlocks();
+
+    // next unused SSA version of a variable
+    int newVersion(const std::string &var) { return ++ssaVersions[var]; }
+
+    // merge blocks joined by a jump neither side shares, skip empty blocks and drop unreachable ones, until none are left
+    void simplifyCFG();
+
+    // copy small blocks onto the incoming edges where their branch is already decided, and fold branches
+    // decided on the only way in
+    void threadJumps();
+
+    // pruned SSA only places phis for variables live into the join block
+    void convertSSA(bool pruned = false);
+
+    // value numbering within each block, or across blocks along the dominator tree
+    void valueNumberingPass();
+    void globalValueNumbering();
+
+    // move computations onto the edges where they are missing, so ones partially redundant at a merge can be deleted
+    void eliminatePartialRedundancies();
+
+    void deadCodeElimination();
+
+    // replace multiplications by constants with additions, carried from one iteration to the next for induction variables
+    void reduceStrength();
+
+    // copy the bodies of loops with a constant trip count, every iteration when that adds at most budget instructions,
+    // otherwise factor copies per iteration behind the leftover ones
+    void unrollLoops(size_t budget, size_t factor);
+
+    // move branches on values a loop never changes in front of it, copying the loop for the other way,
+    // while the copies add at most budget instructions
+    void unswitchLoops(size_t budget);
+
+    // replace every variable copy with its source
+    void copyPropagation();
+
+    // leave SSA form, turning phis into copies on their incoming edges
+    void destructSSA();
+
+    // rename temporaries onto as few names as liveness allows, after which a temporary can be written more than once
+    void reuseTemps();
 
     // register temp values with method from method builder to allow operating on them with SSA
     void registerTemp(std::string tmp) {temps.push_back(tmp);};
 
+    // fresh temporary for passes, numbered after the ones lowering made
+    LclPtr newTemp() {
+        auto tmp = "tmp" + std::to_string(temps.size() + 1);
+        registerTemp(tmp);
+        return std::make_shared<Local>(tmp, 0, true);
+    }
+
     ~MethodIR() = default;
     MethodIR(std::string nm, std::vector<std::pair<std::string, std::string>> typedLcls, std::vector<std::pair<std::string, std::string>> typedArs): 
         name(nm), typedLocals(typedLcls), typedArgs(typedArs) { 
@@ -560,7 +1080,7 @@ struct ClassMetadata {
     }
 
     // output vtable for the method
-    void outputIR() const;
+    void outputIR(IRWriter &out) const;
     
     ClassMetadata(std::string nm, std::vector<std::pair<std::string, std::string>> typedFlds): 
         name(nm), typedFields(typedFlds) {}
@@ -573,10 +1093,16 @@ struct CFG {
     std::map<std::string, std::unique_ptr<ClassMetadata>> classinfo;
     std::map<std::string, std::shared_ptr<MethodIR>> methodinfo;
 
-    void outputIR() const;
+    // whether allocations store a gc map, read by lowering
+    bool gcMaps = true;
+
+    void outputIR(IRWriter &out) const;
     void convertSSA();
     void valueNumberingPass();
 
+    // data section with every vtable, followed by the code section header
+    void outputData(IRWriter &out) const;
+
     CFG (std::vector<std::string> allmethods,
             std::map<std::string, std::unique_ptr<ClassMetadata>> classdata,
             std::map<std::string, std::shared_ptr<MethodIR>> methodIR):
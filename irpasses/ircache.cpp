@@ -0,0 +1,153 @@
+#include "ircache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+// bump whenever the entry layout changes, IR emitted differently by another build is told apart by buildId
+#define CACHE_FORMAT "ircache-v4"
+
+IRCache::IRCache(std::string directory, bool keepInMemory):
+    dir(std::move(directory)), inMemory(keepInMemory) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+
+        if (ec)
+            throw std::runtime_error("Could not create cache directory '" + dir + "'");
+    }
+
+unsigned long IRCache::hashKey(std::string_view key) {
+    // 64 bit FNV-1a
+    unsigned long h = 0xcbf29ce484222325UL;
+
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3UL;
+    }
+
+    return h;
+}
+
+// hash of the running compiler's executable, read once, so entries written by any other build are never reused
+static const std::string &buildId() {
+    static const std::string id = [] {
+        std::ifstream self("/proc/self/exe", std::ios::binary);
+        std::ostringstream content;
+        content << self.rdbuf();
+
+        char hash[24];
+        snprintf(hash, sizeof(hash), "%016lx", IRCache::hashKey(content.str()));
+        return std::string(hash);
+    }();
+
+    return id;
+}
+
+std::string IRCache::entryPath(const std::string &key) const {
+    char name[24];
+    snprintf(name, sizeof(name), "%016lx.ir", hashKey(key));
+    return dir + "/" + name;
+}
+
+void IRCache::remember(const std::string &key, std::string_view ir) const {
+    if (!inMemory)
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto hash = hashKey(key);
+
+    if (auto old = memory.find(hash); old != memory.end()) {
+        memoryBytes -= old->second->key.size() + old->second->ir.size();
+        recent.erase(old->second);
+        memory.erase(old);
+    }
+
+    recent.push_front({hash, key, std::string(ir)});
+    memory[hash] = recent.begin();
+    memoryBytes += key.size() + ir.size();
+
+    // the entry just stored stays even when it alone is over the limit
+    while (memoryBytes > memoryLimit && recent.size() > 1) {
+        auto &last = recent.back();
+        memoryBytes -= last.key.size() + last.ir.size();
+        memory.erase(last.hash);
+        recent.pop_back();
+    }
+}
+
+std::optional<std::string> IRCache::lookup(const std::string &key) const {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = memory.find(hashKey(key));
+
+        if (entry != memory.end() && entry->second->key == key) {
+            recent.splice(recent.begin(), recent, entry->second);
+            return entry->second->ir;
+        }
+    }
+
+    if (dir.empty())
+        return std::nullopt;
+
+    std::ifstream in(entryPath(key), std::ios::binary);
+
+    if (!in.is_open())
+        return std::nullopt;
+
+    std::ostringstream content;
+    content << in.rdbuf();
+    std::string entry = content.str();
+
+    // entry layout is: format tag, build id, key length, newline, key, then the IR text
+    std::string header = std::string(CACHE_FORMAT) + " " + buildId() + " " + std::to_string(key.size()) + "\n";
+
+    if (entry.compare(0, header.size(), header) != 0)
+        return std::nullopt;
+
+    if (entry.compare(header.size(), key.size(), key) != 0)
+        return std::nullopt;
+
+    auto ir = entry.substr(header.size() + key.size());
+    remember(key, ir);
+
+    return ir;
+}
+
+void IRCache::store(const std::string &key, std::string_view ir) const {
+    remember(key, ir);
+
+    if (dir.empty())
+        return;
+
+    auto path = entryPath(key);
+
+    // write next to the entry and rename over it so concurrent readers never see a partial entry
+    std::ostringstream tmpname;
+    tmpname << path << ".tmp" << getpid() << "." << std::this_thread::get_id();
+    auto tmp = tmpname.str();
+
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+
+        if (!out.is_open())
+            return;
+
+        out << CACHE_FORMAT << " " << buildId() << " " << key.size() << "\n" << key << ir;
+
+        if (!out.good()) {
+            out.close();
+            std::filesystem::remove(tmp);
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+
+    if (ec)
+        std::filesystem::remove(tmp, ec);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+
+// Cache of emitted IR text keyed by an arbitrary key string
+// Entries are stored under a hash of the key, and the full key is kept in the entry so that
+// hash collisions are detected rather than returning IR for the wrong method
+// Long running processes can also keep the entries they use most in memory to skip the disk after the first hit
+class IRCache {
+    std::string dir;
+    bool inMemory = true;
+
+    struct MemoryEntry {
+        unsigned long hash;
+        std::string key;
+        std::string ir;
+    };
+
+    // most recently used first, dropped from the back once the entries hold more than memoryLimit bytes
+    mutable std::mutex lock;
+    mutable std::list<MemoryEntry> recent;
+    mutable std::unordered_map<unsigned long, std::list<MemoryEntry>::iterator> memory;
+    mutable size_t memoryBytes = 0;
+    size_t memoryLimit = defaultMemoryLimit;
+
+    std::string entryPath(const std::string &key) const;
+    void remember(const std::string &key, std::string_view ir) const;
+
+public:
+    static constexpr size_t defaultMemoryLimit = 64 << 20;
+
+    // memory only cache
+    IRCache() = default;
+
+    // cache backed by entries in the given directory
+    explicit IRCache(std::string directory, bool keepInMemory = false);
+
+    // keys and IR kept in memory past this many bytes evict the least recently used entries
+    void setMemoryLimit(size_t bytes) { memoryLimit = bytes; }
+
+    std::optional<std::string> lookup(const std::string &key) const;
+    void store(const std::string &key, std::string_view ir) const;
+
+    static unsigned long hashKey(std::string_view key);
+};
@@ -0,0 +1,63 @@
+#include "irwriter.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+IRWriter::IRWriter(int outfd, size_t cap):
+    buffer(std::make_unique_for_overwrite<char[]>(cap)), capacity(cap), fd(outfd) {}
+
+IRWriter::IRWriter(const std::string &path, size_t cap):
+    buffer(std::make_unique_for_overwrite<char[]>(cap)), capacity(cap) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd < 0)
+            throw std::runtime_error("Could not open output file '" + path + "'");
+
+        ownsFd = true;
+    }
+
+IRWriter::IRWriter(std::string &out, size_t cap):
+    buffer(std::make_unique_for_overwrite<char[]>(cap)), capacity(cap), target(&out) {}
+
+IRWriter::~IRWriter() {
+    // errors cannot be thrown out of a destructor, so callers that care should flush explicitly
+    try {
+        flush();
+    } catch (const std::exception &) {}
+
+    if (ownsFd)
+        close(fd);
+}
+
+void IRWriter::flush() {
+    if (!used)
+        return;
+
+    // reset before draining so a failed write does not get retried by the destructor
+    auto len = used;
+    used = 0;
+    drain(buffer.get(), len);
+}
+
+void IRWriter::drain(const char *data, size_t len) {
+    if (target) {
+        target->append(data, len);
+        return;
+    }
+
+    while (len > 0) {
+        auto written = ::write(fd, data, len);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            throw std::runtime_error("Failed to write IR output");
+        }
+
+        data += written;
+        len -= written;
+    }
+}
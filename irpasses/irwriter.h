@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <concepts>
+#include <memory>
+
+// Buffered sink for emitted IR text
+// Tokens are collected in one large buffer that is reused between flushes, and only full buffers
+// are handed to write(2) (or appended to a string when output is kept in memory)
+class IRWriter {
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t used = 0;
+
+    int fd = -1;
+    bool ownsFd = false;
+    std::string *target = nullptr;
+
+    void drain(const char *data, size_t len);
+
+    IRWriter(std::string &out, size_t cap);
+
+public:
+    static constexpr size_t defaultCapacity = 1 << 20;
+
+    // write to an already open file descriptor (stdout by default), which is not closed by the writer
+    explicit IRWriter(int outfd = 1, size_t cap = defaultCapacity);
+
+    // create or truncate the file at path and write to it
+    explicit IRWriter(const std::string &path, size_t cap = defaultCapacity);
+
+    // append output to a string instead of a file, named so a string holding a path never lands here
+    static IRWriter toString(std::string &out, size_t cap = defaultCapacity) {
+        return IRWriter(out, cap);
+    }
+
+    IRWriter(const IRWriter &) = delete;
+    IRWriter &operator=(const IRWriter &) = delete;
+
+    ~IRWriter();
+
+    void write(const char *data, size_t len) {
+        if (used + len > capacity) {
+            flush();
+
+            // oversized writes skip the buffer entirely
+            if (len > capacity) {
+                drain(data, len);
+                return;
+            }
+        }
+
+        std::char_traits<char>::copy(buffer.get() + used, data, len);
+        used += len;
+    }
+
+    IRWriter &operator<<(std::string_view s) {
+        write(s.data(), s.size());
+        return *this;
+    }
+
+    IRWriter &operator<<(const char *s) {
+        return *this << std::string_view(s);
+    }
+
+    IRWriter &operator<<(const std::string &s) {
+        write(s.data(), s.size());
+        return *this;
+    }
+
+    IRWriter &operator<<(char c) {
+        if (used == capacity)
+            flush();
+
+        buffer[used++] = c;
+        return *this;
+    }
+
+    // numbers are formatted on the stack, which has room for any 64 bit value with sign whatever the capacity
+    template <std::integral T>
+    IRWriter &operator<<(T v) {
+        char digits[24];
+        auto res = std::to_chars(digits, digits + sizeof(digits), v);
+        write(digits, res.ptr - digits);
+        return *this;
+    }
+
+    void flush();
+};
@@ -0,0 +1,418 @@
+// jumpthread.cpp : sends predecessors that already know how a branch goes straight to the successor it picks
+#include "ir.h"
+#include "passstats.h"
+#include "ssaupdater.h"
+
+#include <algorithm>
+#include <functional>
+
+// blocks copied onto a threaded edge are limited to this many instructions
+static const size_t threadLimit = 4;
+
+// what is known about a value at some point
+struct Fact {
+    std::optional<long> exact;
+    std::optional<bool> truth;
+
+    bool known() const { return exact || truth; }
+};
+
+// instructions by the value they define, to see what a branch condition compared
+using Defs = std::unordered_map<std::string, IROp *>;
+
+// what taking the edge from -> to tells about v, when from ends in a conditional
+static Fact edgeFact(const ValPtr &v, BasicBlock *from, BasicBlock *to, const Defs &defs) {
+    auto cond = dynamic_cast<Conditional *>(from->blockTransfer.get());
+    if (!cond || cond->trueTarget == cond->falseTarget)
+        return {};
+
+    bool taken = cond->trueTarget == to;
+
+    if (sameValue(cond->condition, v))
+        return taken ? Fact{std::nullopt, true} : Fact{0, false};
+
+    // a test of v against a constant pins v on one edge, and against 0 also tells its truth on the other
+    auto lcl = asLocal(cond->condition);
+    auto it = lcl ? defs.find(valueKey(*lcl)) : defs.end();
+    auto bin = it == defs.end() ? nullptr : dynamic_cast<BinInst *>(it->second);
+
+    if (!bin || (bin->op != Oper::Eq && bin->op != Oper::Ne))
+        return {};
+
+    auto other = sameValue(bin->lhs, v) ? bin->rhs : sameValue(bin->rhs, v) ? bin->lhs : nullptr;
+    auto k = other ? dynamic_cast<Const *>(other.get()) : nullptr;
+
+    if (!k)
+        return {};
+
+    if ((bin->op == Oper::Eq) == taken)
+        return {k->value, k->value != 0};
+
+    return k->value == 0 ? Fact{std::nullopt, true} : Fact{};
+}
+
+// what is known about a value defined outside block when control comes in from pred, from the edge itself
+// and from every edge that is the only way into a dominator of pred
+static Fact factAt(const ValPtr &v, BasicBlock *pred, BasicBlock *block, const Defs &defs) {
+    if (auto k = dynamic_cast<Const *>(v.get()))
+        return {k->value, k->value != 0};
+
+    if (!asLocal(v) || !pred)
+        return {};
+
+    auto fact = edgeFact(v, pred, block, defs);
+
+    for (auto n = pred; n && !fact.known(); n = n->immediateDominator)
+        if (n->predecessors.size() == 1)
+            fact = edgeFact(v, *n->predecessors.begin(), n, defs);
+
+    return fact;
+}
+
+// evaluates the branch condition of a block as it would run when entered from one predecessor,
+// or from any of them when pred is null
+class EdgeEvaluator {
+    BasicBlock *block;
+    BasicBlock *pred;
+    const Defs &defs;
+
+    // values defined in block, by the phi or instruction defining them
+    std::unordered_map<std::string, Phi *> phis;
+    std::unordered_map<std::string, IROp *> insts;
+
+    ValPtr incoming(Phi *phi) const {
+        if (!pred)
+            return nullptr;
+
+        for (auto &[label, val] : phi->incoming)
+            if (label == pred->label)
+                return val;
+
+        return nullptr;
+    }
+
+    // a phi argument is a value at the end of pred, never one computed in this pass through block
+    Fact outside(const ValPtr &v) const {
+        return v ? factAt(v, pred, block, defs) : Fact{};
+    }
+
+public:
+    EdgeEvaluator(BasicBlock *b, BasicBlock *p, const Defs &d): block(b), pred(p), defs(d) {
+        for (auto &phi : block->blockPhi)
+            phis[valueKey(Local(phi->outputVar, phi->resultVersion))] = phi.get();
+
+        for (auto &inst : block->instructions)
+            if (auto res = inst->result(); res && asLocal(*res))
+                insts[valueKey(*asLocal(*res))] = inst.get();
+    }
+
+    std::optional<long> exact(const ValPtr &v) const {
+        auto lcl = asLocal(v);
+        if (!lcl)
+            return outside(v).exact;
+
+        auto key = valueKey(*lcl);
+
+        if (auto it = phis.find(key); it != phis.end())
+            return outside(incoming(it->second)).exact;
+
+        if (auto it = insts.find(key); it != insts.end()) {
+            if (auto asn = dynamic_cast<Assign *>(it->second))
+                return exact(asn->src);
+
+            if (auto bin = dynamic_cast<BinInst *>(it->second)) {
+                auto l = exact(bin->lhs);
+                auto r = l ? exact(bin->rhs) : std::nullopt;
+                return r ? foldBinary(bin->op, *l, *r) : std::nullopt;
+            }
+
+            return std::nullopt;
+        }
+
+        return outside(v).exact;
+    }
+
+    std::optional<bool> truth(const ValPtr &v) const {
+        if (auto e = exact(v))
+            return *e != 0;
+
+        auto lcl = asLocal(v);
+        if (!lcl)
+            return std::nullopt;
+
+        auto key = valueKey(*lcl);
+
+        if (auto it = phis.find(key); it != phis.end())
+            return outside(incoming(it->second)).truth;
+
+        if (auto it = insts.find(key); it != insts.end()) {
+            if (auto asn = dynamic_cast<Assign *>(it->second))
+                return truth(asn->src);
+
+            // x != 0 and x == 0 follow the truth of x
+            auto bin = dynamic_cast<BinInst *>(it->second);
+            if (!bin || (bin->op != Oper::Eq && bin->op != Oper::Ne))
+                return std::nullopt;
+
+            auto zero = [](const ValPtr &k) { auto c = dynamic_cast<Const *>(k.get()); return c && c->value == 0; };
+            auto other = zero(bin->rhs) ? bin->lhs : zero(bin->lhs) ? bin->rhs : nullptr;
+            auto t = other ? truth(other) : std::nullopt;
+
+            if (t && bin->op == Oper::Eq)
+                return !*t;
+
+            return t;
+        }
+
+        return outside(v).truth;
+    }
+};
+
+static std::unique_ptr<IROp> cloneWith(IROp *inst, ValPtr dest, const std::function<ValPtr(const ValPtr &)> &map) {
+    if (auto asn = dynamic_cast<Assign *>(inst))
+        return std::make_unique<Assign>(std::move(dest), map(asn->src));
+
+    auto bin = static_cast<BinInst *>(inst);
+    return std::make_unique<BinInst>(std::move(dest), bin->op, map(bin->lhs), map(bin->rhs));
+}
+
+// the successor the branch ending block takes when entered from pred, or null if that is not known
+static BasicBlock *knownTarget(BasicBlock *block, BasicBlock *pred, const Defs &defs) {
+    auto cond = static_cast<Conditional *>(block->blockTransfer.get());
+    auto truth = EdgeEvaluator(block, pred, defs).truth(cond->condition);
+
+    if (!truth)
+        return nullptr;
+
+    return *truth ? cond->trueTarget : cond->falseTarget;
+}
+
+// a branch decided before the block is even entered becomes a jump
+static void foldBranch(BasicBlock *block, BasicBlock *target) {
+    auto cond = static_cast<Conditional *>(block->blockTransfer.get());
+    auto dropped = cond->trueTarget == target ? cond->falseTarget : cond->trueTarget;
+
+    dropped->predecessors.erase(block);
+
+    for (auto &phi : dropped->blockPhi)
+        std::erase_if(phi->incoming, [&](auto &in) { return in.first == block->label; });
+
+    block->blockTransfer = std::make_unique<Jump>(target);
+}
+
+// whether the values block defines can be given second definitions in a copy of it
+static bool threadable(MethodIR &method, BasicBlock *block) {
+    if (block->instructions.size() > threadLimit)
+        return false;
+
+    std::set<std::string> temps;
+
+    for (auto &inst : block->instructions) {
+        if (!dynamic_cast<Assign *>(inst.get()) && !dynamic_cast<BinInst *>(inst.get()))
+            return false;
+
+        auto dest = asLocal(*inst->result());
+        if (!dest)
+            return false;
+
+        if (dest->ignoreSSA)
+            temps.insert(valueKey(*dest));
+    }
+
+    // temporaries are not versioned, so one read past the block could not tell its two definitions apart
+    auto readsTemp = [&](const std::vector<ValPtr *> &slots) {
+        return std::any_of(slots.begin(), slots.end(), [&](ValPtr *slot) {
+            auto lcl = asLocal(*slot);
+            return lcl && temps.contains(valueKey(*lcl));
+        });
+    };
+
+    for (auto &other : method.blocks) {
+        for (auto &phi : other->blockPhi)
+            if (readsTemp(phi->operands()))
+                return false;
+
+        if (other.get() == block)
+            continue;
+
+        for (auto &inst : other->instructions)
+            if (readsTemp(inst->operands()))
+                return false;
+
+        if (readsTemp(other->blockTransfer->operands()))
+            return false;
+    }
+
+    return true;
+}
+
+// copies block onto the edge from pred, ending in a jump to target, and restores SSA form for its values
+static void threadEdge(MethodIR &method, BasicBlock *block, BasicBlock *pred, BasicBlock *target) {
+    auto copy = method.newBasicBlock();
+    copy->blockTransfer = std::make_unique<Jump>(target);
+
+    // every value block defines, paired with what it is on the threaded edge
+    std::vector<std::pair<ValPtr, ValPtr>> defined;
+    std::unordered_map<std::string, ValPtr> renamed;
+
+    for (auto &phi : block->blockPhi)
+        for (auto &[label, val] : phi->incoming)
+            if (label == pred->label) {
+                auto result = std::make_shared<Local>(phi->outputVar, phi->resultVersion);
+                renamed[valueKey(*result)] = val;
+                defined.push_back({result, val});
+            }
+
+    auto map = [&](const ValPtr &v) {
+        auto lcl = asLocal(v);
+        auto it = lcl ? renamed.find(valueKey(*lcl)) : renamed.end();
+        return it == renamed.end() ? v : it->second;
+    };
+
+    for (auto &inst : block->instructions) {
+        auto dest = asLocal(*inst->result());
+        ValPtr fresh = dest->ignoreSSA ? method.newTemp() : std::make_shared<Local>(dest->name, method.newVersion(dest->name));
+
+        copy->instructions.push_back(cloneWith(inst.get(), fresh, map));
+        renamed[valueKey(*dest)] = fresh;
+
+        if (!dest->ignoreSSA)
+            defined.push_back({*inst->result(), fresh});
+    }
+
+    pred->blockTransfer->replaceSuccessor(block, copy);
+
+    for (auto &phi : block->blockPhi)
+        std::erase_if(phi->incoming, [&](auto &in) { return in.first == pred->label; });
+
+    for (auto &phi : target->blockPhi)
+        for (size_t i = 0, n = phi->incoming.size(); i < n; i++)
+            if (phi->incoming[i].first == block->label)
+                phi->incoming.push_back({copy->label, phi->incoming[i].second});
+
+    block->predecessors.erase(pred);
+    copy->predecessors.insert(pred);
+    target->predecessors.insert(copy);
+
+    std::map<std::string, BasicBlock *> byLabel;
+    for (auto &b : method.blocks)
+        byLabel[b->label] = b.get();
+
+    // values of block now reach later uses from two places, the updater merges them with phis where paths join
+    for (auto &[original, onEdge] : defined) {
+        auto lcl = asLocal(original);
+        SSAUpdater updater(method, lcl->name);
+        updater.addDefinition(block, original);
+        updater.addDefinition(copy, onEdge);
+
+        for (auto &b : method.blocks) {
+            for (auto &phi : b->blockPhi)
+                for (auto &[label, val] : phi->incoming) {
+                    if (!sameValue(val, original) || label == block->label)
+                        continue;
+
+                    if (label == copy->label)
+                        val = onEdge;
+                    else
+                        updater.rewriteUse(&val, byLabel.at(label));
+                }
+
+            if (b.get() == block || b.get() == copy)
+                continue;
+
+            for (auto &inst : b->instructions)
+                for (auto slot : inst->operands())
+                    if (sameValue(*slot, original))
+                        updater.rewriteUse(slot, b.get());
+
+            for (auto slot : b->blockTransfer->operands())
+                if (sameValue(*slot, original))
+                    updater.rewriteUse(slot, b.get());
+        }
+    }
+}
+
+void MethodIR::threadJumps() {
+    size_t threaded = 0;
+
+    // every thread adds a block, so their number is capped by the size the method started with
+    size_t limit = blocks.size();
+
+    while (threaded < limit) {
+        requireAnalyses(Predecessors | Dominators);
+
+        Defs defs;
+        for (auto &block : blocks)
+            for (auto &inst : block->instructions)
+                if (auto res = inst->result(); res && asLocal(*res))
+                    defs[valueKey(*asLocal(*res))] = inst.get();
+
+        bool changed = false;
+
+        for (size_t i = 0; i < blocks.size() && !changed; i++) {
+            auto block = blocks[i].get();
+            auto cond = dynamic_cast<Conditional *>(block->blockTransfer.get());
+
+            if (!cond || cond->trueTarget == cond->falseTarget)
+                continue;
+
+            // a test of constants goes the same way however the block is entered
+            if (auto target = knownTarget(block, nullptr, defs)) {
+                foldBranch(block, target);
+                changed = true;
+                continue;
+            }
+
+            if (block == getStartBlock() || block->predecessors.empty())
+                continue;
+
+            std::vector<BasicBlock *> preds(block->predecessors.begin(), block->predecessors.end());
+            std::sort(preds.begin(), preds.end(), [](BasicBlock *a, BasicBlock *b) { return a->label < b->label; });
+
+            if (preds.size() == 1) {
+                if (auto target = knownTarget(block, preds[0], defs)) {
+                    foldBranch(block, target);
+                    changed = true;
+                }
+
+                continue;
+            }
+
+            std::optional<bool> copyable;
+
+            for (auto pred : preds) {
+                auto target = knownTarget(block, pred, defs);
+
+                if (!target || target == block || pred == block)
+                    continue;
+
+                // a predecessor with both edges into block would need a copy per edge
+                if (auto pc = dynamic_cast<Conditional *>(pred->blockTransfer.get()); pc && pc->trueTarget == pc->falseTarget)
+                    continue;
+
+                if (!copyable)
+                    copyable = threadable(*this, block);
+
+                if (!*copyable)
+                    break;
+
+                threadEdge(*this, block, pred, target);
+                changed = true;
+                break;
+            }
+        }
+
+        if (!changed)
+            break;
+
+        threaded++;
+        keepAnalyses(Predecessors);
+    }
+
+    // folded branches and threaded edges can leave blocks nothing reaches any more, with phi arguments
+    // from them still in the blocks they led to, which loop passes walking predecessors do not expect
+    removeUnreachableBlocks();
+
+    if (auto stats = PassStats::active())
+        stats->jumpsThreaded += threaded;
+}
@@ -0,0 +1,348 @@
+// loops.cpp : natural loops, their induction variables and how many times they run
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+#include <bit>
+
+const Induction *Loop::induction(const ValPtr &v) const {
+    for (auto &iv : inductions)
+        if (sameValue(iv.value, v))
+            return &iv;
+
+    return nullptr;
+}
+
+Loop *LoopForest::loopFor(const BasicBlock *block) const {
+    auto it = innermost.find(block);
+    return it == innermost.end() ? nullptr : it->second;
+}
+
+static bool invariant(const ValPtr &v, const Loop &loop) {
+    auto lcl = asLocal(v);
+    return !lcl || !loop.definitions.contains(valueKey(*lcl));
+}
+
+static void findInductions(Loop &loop) {
+    auto &defs = loop.definitions;
+    auto header = loop.header;
+
+    for (auto &phi : header->blockPhi) {
+        ValPtr p = std::make_shared<Local>(phi->outputVar, phi->resultVersion);
+        ValPtr next, start;
+        bool sameStart = true;
+
+        for (auto &[label, val] : phi->incoming) {
+            bool back = std::any_of(loop.latches.begin(), loop.latches.end(), [&](BasicBlock *b) { return b->label == label; });
+
+            if (!back) {
+                sameStart = sameStart && (!start || sameValue(start, val));
+                start = start ? start : val;
+            }
+            else if (!next || sameValue(next, val))
+                next = val;
+            else {
+                next = nullptr;
+                break;
+            }
+        }
+
+        auto lcl = next ? asLocal(next) : nullptr;
+        auto it = lcl ? defs.find(valueKey(*lcl)) : defs.end();
+        auto bin = it == defs.end() ? nullptr : dynamic_cast<BinInst *>(it->second.first);
+
+        if (!bin)
+            continue;
+
+        Const *k = nullptr;
+        if (bin->op == Oper::Add)
+            k = sameValue(bin->lhs, p) ? asConst(bin->rhs) : sameValue(bin->rhs, p) ? asConst(bin->lhs) : nullptr;
+        else if (bin->op == Oper::Sub && sameValue(bin->lhs, p))
+            k = asConst(bin->rhs);
+
+        if (!k)
+            continue;
+
+        Induction iv;
+        iv.value = p;
+        iv.basis = loop.inductions.size();
+        iv.step = bin->op == Oper::Sub ? -(unsigned long) k->value : k->value;
+        iv.start = sameStart ? start : nullptr;
+        iv.next = next;
+        loop.inductions.push_back(iv);
+    }
+
+    // derived values, walking the loop's part of the dominator tree so operands are seen before their uses
+    std::vector<BasicBlock *> work = {header};
+
+    while (!work.empty()) {
+        auto block = work.back();
+        work.pop_back();
+
+        for (auto child : block->domChildren)
+            if (loop.contains(child))
+                work.push_back(child);
+
+        for (auto &inst : block->instructions) {
+            auto bin = dynamic_cast<BinInst *>(inst.get());
+            if (!bin || !asLocal(bin->dest) || loop.induction(bin->dest))
+                continue;
+
+            auto lk = asConst(bin->lhs);
+            auto rk = asConst(bin->rhs);
+            auto from = loop.induction(lk ? bin->rhs : bin->lhs);
+            auto k = lk ? lk : rk;
+
+            if (!from || !k)
+                continue;
+
+            auto c = (unsigned long) k->value;
+            Induction iv = *from;
+
+            if (bin->op == Oper::Add)
+                iv.offset += c;
+            else if (bin->op == Oper::Sub && rk)
+                iv.offset -= c;
+            else if (bin->op == Oper::Sub) {
+                iv.scale = -iv.scale;
+                iv.offset = c - iv.offset;
+            }
+            else if (bin->op == Oper::Mul) {
+                iv.scale *= c;
+                iv.offset *= c;
+            }
+            else
+                continue;
+
+            auto &basis = loop.inductions[from->basis];
+            iv.value = bin->dest;
+            iv.step = basis.step * iv.scale;
+            iv.start = nullptr;
+            iv.next = nullptr;
+            loop.inductions.push_back(iv);
+        }
+    }
+}
+
+// inverse of an odd number modulo 2^64, each Newton step doubles the bits that are right
+static unsigned long inverse(unsigned long a) {
+    unsigned long x = a;
+
+    for (int i = 0; i < 6; i++)
+        x *= 2 - a * x;
+
+    return x;
+}
+
+// header runs for constant bounds, empty when the tested value would wrap past the limit or never meet it
+static std::optional<unsigned long> countRuns(const TripCount &trip, unsigned long first, unsigned long limit) {
+    unsigned long k = 0;
+
+    switch (trip.kind) {
+        case TripCount::Below: {
+            if (first >= limit)
+                return 1;
+
+            k = (limit - first) / trip.step + ((limit - first) % trip.step != 0);
+            if (k > (~0UL - first) / trip.step)
+                return std::nullopt;
+
+            break;
+        }
+
+        case TripCount::Above: {
+            unsigned long down = -trip.step;
+            if (first <= limit)
+                return 1;
+
+            k = (first - limit) / down + ((first - limit) % down != 0);
+            if (k > first / down)
+                return std::nullopt;
+
+            break;
+        }
+
+        case TripCount::Until: {
+            // first + k * step == limit modulo 2^64, solvable when the power of two in step divides the distance
+            unsigned long distance = limit - first;
+            int shift = std::countr_zero(trip.step);
+
+            if (distance & ((1UL << shift) - 1))
+                return std::nullopt;
+
+            k = (distance >> shift) * inverse(trip.step >> shift);
+            if (shift)
+                k &= ~0UL >> shift;
+
+            break;
+        }
+    }
+
+    if (k == ~0UL)
+        return std::nullopt;
+
+    return k + 1;
+}
+
+// a loop whose only exit tests an induction variable against a value the loop leaves alone, on every iteration
+static std::optional<TripCount> findTripCount(const Loop &loop) {
+    auto &defs = loop.definitions;
+
+    if (loop.exiting.size() != 1)
+        return std::nullopt;
+
+    auto exiting = loop.exiting[0];
+    auto cond = dynamic_cast<Conditional *>(exiting->blockTransfer.get());
+
+    if (!cond || cond->trueTarget == cond->falseTarget)
+        return std::nullopt;
+
+    if (!std::all_of(loop.latches.begin(), loop.latches.end(), [&](BasicBlock *b) { return b->dominatedBy(exiting); }))
+        return std::nullopt;
+
+    auto lcl = asLocal(cond->condition);
+    auto it = lcl ? defs.find(valueKey(*lcl)) : defs.end();
+    auto test = it == defs.end() ? nullptr : dynamic_cast<BinInst *>(it->second.first);
+
+    if (!test)
+        return std::nullopt;
+
+    auto op = test->op;
+    auto iv = loop.induction(test->lhs);
+    auto limit = test->rhs;
+
+    if (!iv) {
+        iv = loop.induction(test->rhs);
+        limit = test->lhs;
+        op = op == Oper::Lt ? Oper::Gt : op == Oper::Gt ? Oper::Lt : op;
+    }
+
+    if (!iv || iv->scale != 1 || !invariant(limit, loop))
+        return std::nullopt;
+
+    auto &basis = loop.inductions[iv->basis];
+    if (!basis.start || iv->step == 0)
+        return std::nullopt;
+
+    bool stayWhenTrue = loop.contains(cond->trueTarget);
+    bool ascending = (long) iv->step > 0;
+
+    TripCount trip{TripCount::Until, basis.start, iv->offset, iv->step, limit};
+
+    if (op == Oper::Lt && stayWhenTrue && ascending)
+        trip.kind = TripCount::Below;
+    else if (op == Oper::Gt && stayWhenTrue && !ascending)
+        trip.kind = TripCount::Above;
+    else if (!((op == Oper::Ne && stayWhenTrue) || (op == Oper::Eq && !stayWhenTrue)))
+        return std::nullopt;
+
+    auto s = asConst(basis.start);
+    auto l = asConst(limit);
+
+    if (s && l) {
+        trip.constant = countRuns(trip, s->value + iv->offset, l->value);
+
+        // known bounds that never meet leave the count unknown
+        if (!trip.constant)
+            return std::nullopt;
+    }
+
+    return trip;
+}
+
+void LoopForest::build(MethodIR &method) {
+    loops.clear();
+    nested.clear();
+    innermost.clear();
+
+    for (auto &blockPtr : method.blocks) {
+        auto header = blockPtr.get();
+        std::vector<BasicBlock *> latches;
+
+        for (auto pred : header->predecessors)
+            if (pred->dominatedBy(header))
+                latches.push_back(pred);
+
+        if (latches.empty())
+            continue;
+
+        auto &loop = loops.emplace_back();
+        loop.header = header;
+        loop.members.insert(header);
+
+        // every block on the way back to a latch is dominated by the header, unless nothing reaches it
+        std::vector<BasicBlock *> work = latches;
+
+        while (!work.empty()) {
+            auto block = work.back();
+            work.pop_back();
+
+            if (block->dominatedBy(header) && loop.members.insert(block).second)
+                work.insert(work.end(), block->predecessors.begin(), block->predecessors.end());
+        }
+
+        for (auto &b : method.blocks)
+            if (loop.members.contains(b.get()))
+                loop.blocks.push_back(b.get());
+
+        std::sort(latches.begin(), latches.end(), [](BasicBlock *a, BasicBlock *b) { return a->label < b->label; });
+        loop.latches = latches;
+
+        for (auto block : loop.blocks) {
+            auto succs = block->getNextBlocks();
+
+            if (std::any_of(succs.begin(), succs.end(), [&](BasicBlock *s) { return !loop.contains(s); }))
+                loop.exiting.push_back(block);
+
+            for (auto &phi : block->blockPhi)
+                loop.definitions[valueKey(Local(phi->outputVar, phi->resultVersion))] = {phi.get(), block};
+
+            for (auto &inst : block->instructions)
+                if (auto res = inst->result(); res && asLocal(*res))
+                    loop.definitions[valueKey(*asLocal(*res))] = {inst.get(), block};
+
+            loop.size += block->blockPhi.size() + block->instructions.size() + 1;
+        }
+
+        nested.push_back(&loop);
+    }
+
+    // a loop containing another has more blocks, so larger loops first puts every loop after its parents
+    std::stable_sort(nested.begin(), nested.end(), [](Loop *a, Loop *b) { return a->blocks.size() > b->blocks.size(); });
+
+    for (auto loop : nested) {
+        if (auto parent = loopFor(loop->header)) {
+            loop->parent = parent;
+            loop->depth = parent->depth + 1;
+            parent->children.push_back(loop);
+        }
+
+        for (auto block : loop->blocks)
+            innermost[block] = loop;
+    }
+
+    for (auto &loop : loops) {
+        findInductions(loop);
+        loop.tripCount = findTripCount(loop);
+    }
+}
+
+void MethodIR::computeLoops() {
+    requireAnalyses(Predecessors | Dominators);
+
+    loops.build(*this);
+    validAnalyses |= Loops;
+
+    if (auto stats = PassStats::active()) {
+        // a later run replaces the counts of an earlier one, the method is only counted as it was last seen
+        auto &counts = stats->loopCounts[name];
+        counts = {};
+
+        for (auto loop : loops.all()) {
+            counts.loops++;
+            counts.inductions += loop->inductions.size();
+            counts.tripCounts += loop->tripCount.has_value();
+            counts.constantTrips += loop->tripCount && loop->tripCount->constant;
+        }
+    }
+}
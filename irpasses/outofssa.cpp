@@ -0,0 +1,353 @@
+// outofssa.cpp : replaces phis with copies, first giving values that never overlap one shared name
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+// Sets of SSA values that will share one name
+// Two sets are only merged when no value in one is live where a value of the other is defined
+class Coalescer {
+    std::unordered_map<std::string, int> ids;
+    std::vector<int> parent;
+    std::vector<std::vector<int>> members;
+
+    // name the set is written under, an argument if the set holds one
+    std::vector<ValPtr> name;
+    std::vector<bool> pinned;
+
+    std::unordered_set<long long> edges;
+
+    static long long edge(int a, int b) {
+        return a < b ? (long long) a << 32 | b : (long long) b << 32 | a;
+    }
+
+public:
+    // only phis and copies ever get coalesced, so interference is only tracked between their values
+    void addCandidate(const ValPtr &v) {
+        auto lcl = asLocal(v);
+
+        // this is bound by the interpreter and never written
+        if (!lcl || lcl->name == "this")
+            return;
+
+        auto [it, added] = ids.try_emplace(valueKey(*lcl), parent.size());
+        if (!added)
+            return;
+
+        parent.push_back(it->second);
+        members.push_back({it->second});
+        name.push_back(v);
+
+        // arguments arrive under the names in the method header, so two of them can never share one
+        pinned.push_back(lcl->version == 0 && !lcl->ignoreSSA);
+    }
+
+    int id(const std::string &key) const {
+        auto it = ids.find(key);
+        return it == ids.end() ? -1 : it->second;
+    }
+
+    void interfere(int a, int b) {
+        if (a != b)
+            edges.insert(edge(a, b));
+    }
+
+    int find(int v) {
+        while (parent[v] != v)
+            v = parent[v] = parent[parent[v]];
+
+        return v;
+    }
+
+    // merges the sets of a and b unless two of their values interfere, the name of a's set wins over b's
+    bool tryUnion(int a, int b) {
+        a = find(a);
+        b = find(b);
+
+        if (a == b)
+            return true;
+
+        if (pinned[a] && pinned[b])
+            return false;
+
+        for (auto x : members[a])
+            for (auto y : members[b])
+                if (edges.contains(edge(x, y)))
+                    return false;
+
+        auto keep = pinned[b] ? name[b] : name[a];
+
+        // the smaller set is folded into the larger, so members are copied a logarithmic number of times
+        if (members[a].size() < members[b].size())
+            std::swap(a, b);
+
+        parent[b] = a;
+        members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+        members[b].clear();
+
+        name[a] = keep;
+        pinned[a] = pinned[a] || pinned[b];
+        return true;
+    }
+
+    // the value v is written under once coalesced
+    ValPtr rename(const ValPtr &v) {
+        auto lcl = asLocal(v);
+        int i = lcl ? id(valueKey(*lcl)) : -1;
+
+        return i == -1 ? v : name[find(i)];
+    }
+};
+
+// orders a parallel copy so no destination is overwritten while a later copy still reads it,
+// saving one destination to a temporary wherever the copies form a cycle
+static std::vector<std::unique_ptr<IROp>> sequentialize(std::vector<std::pair<ValPtr, ValPtr>> copies, MethodIR &method) {
+    std::vector<std::unique_ptr<IROp>> ret;
+
+    auto reads = [&](const ValPtr &src, const ValPtr &dst) {
+        auto lcl = asLocal(src);
+        return lcl && sameValue(src, dst);
+    };
+
+    while (!copies.empty()) {
+        auto ready = std::find_if(copies.begin(), copies.end(), [&](auto &copy) {
+            return std::none_of(copies.begin(), copies.end(), [&](auto &other) {
+                return &other != &copy && reads(other.second, copy.first);
+            });
+        });
+
+        if (ready != copies.end()) {
+            ret.push_back(std::make_unique<Assign>(ready->first, ready->second));
+            copies.erase(ready);
+            continue;
+        }
+
+        // every destination left is still read by another copy
+        auto saved = copies[0].first;
+        auto tmp = method.newTemp();
+        ret.push_back(std::make_unique<Assign>(tmp, saved));
+
+        for (auto &copy : copies)
+            if (reads(copy.second, saved))
+                copy.second = tmp;
+    }
+
+    return ret;
+}
+
+void MethodIR::destructSSA() {
+    auto stats = PassStats::active();
+
+    // a copy for a phi argument coming from a branch would also run when the other way is taken
+    requireAnalyses(Predecessors | Dominators);
+
+    std::vector<std::pair<BasicBlock *, BasicBlock *>> critical;
+
+    for (auto &block : blocks) {
+        if (block->blockPhi.empty() || block->predecessors.size() < 2)
+            continue;
+
+        for (auto pred : block->predecessors)
+            if (pred->getNextBlocks().size() > 1)
+                critical.push_back({pred, block.get()});
+    }
+
+    std::vector<BasicBlock *> splits;
+
+    for (auto [from, to] : critical)
+        splits.push_back(splitEdge(from, to));
+
+    requireAnalyses(Liveness);
+
+    Coalescer sets;
+
+    for (auto &block : blocks) {
+        for (auto &phi : block->blockPhi) {
+            sets.addCandidate(std::make_shared<Local>(phi->outputVar, phi->resultVersion));
+
+            for (auto &[_, val] : phi->incoming)
+                sets.addCandidate(val);
+        }
+
+        for (auto &inst : block->instructions)
+            if (auto asn = dynamic_cast<Assign *>(inst.get()); asn && asLocal(asn->src)) {
+                sets.addCandidate(asn->dest);
+                sets.addCandidate(asn->src);
+            }
+    }
+
+    // a value interferes with every value live where it is defined, walking each block backwards from its live out set
+    for (auto &block : blocks) {
+        std::set<std::string> live = block->liveOut;
+
+        auto use = [&](const ValPtr &v) {
+            if (auto lcl = asLocal(v))
+                live.insert(valueKey(*lcl));
+        };
+
+        auto define = [&](const std::string &key, const std::string &except) {
+            int d = sets.id(key);
+
+            if (d != -1)
+                for (auto &other : live)
+                    if (other != except)
+                        if (int o = sets.id(other); o != -1)
+                            sets.interfere(d, o);
+
+            live.erase(key);
+        };
+
+        for (auto op : block->blockTransfer->operands())
+            use(*op);
+
+        for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); it++) {
+            auto inst = it->get();
+
+            if (auto res = inst->result())
+                if (auto lcl = asLocal(*res)) {
+                    // a copy and its source hold the same value, so they can share a name even while both live
+                    auto asn = dynamic_cast<Assign *>(inst);
+                    auto src = asn ? asLocal(asn->src) : nullptr;
+
+                    define(valueKey(*lcl), src ? valueKey(*src) : "");
+                }
+
+            for (auto op : inst->operands())
+                use(*op);
+        }
+
+        // phis all write on entry, so they interfere with each other and with everything live past them
+        std::vector<std::string> results;
+
+        for (auto &phi : block->blockPhi) {
+            results.push_back(valueKey(Local(phi->outputVar, phi->resultVersion)));
+            live.erase(results.back());
+        }
+
+        for (auto &key : results) {
+            define(key, "");
+
+            for (auto &other : results)
+                if (int a = sets.id(key), b = sets.id(other); a != -1 && b != -1)
+                    sets.interfere(a, b);
+        }
+    }
+
+    // phi arguments first, they are the copies that would run on every edge
+    for (auto &block : blocks)
+        for (auto &phi : block->blockPhi) {
+            int result = sets.id(valueKey(Local(phi->outputVar, phi->resultVersion)));
+
+            for (auto &[_, val] : phi->incoming)
+                if (auto lcl = asLocal(val); lcl && result != -1)
+                    if (int arg = sets.id(valueKey(*lcl)); arg != -1)
+                        sets.tryUnion(result, arg);
+        }
+
+    for (auto &block : blocks)
+        for (auto &inst : block->instructions)
+            if (auto asn = dynamic_cast<Assign *>(inst.get()); asn && asLocal(asn->src))
+                if (int d = sets.id(valueKey(*asLocal(asn->dest))), s = sets.id(valueKey(*asLocal(asn->src))); d != -1 && s != -1)
+                    sets.tryUnion(d, s);
+
+    size_t coalesced = 0;
+    size_t inserted = 0;
+    size_t removedPhis = 0;
+
+    // every value is written and read under its set's name, copies within one set have nothing left to do
+    for (auto &block : blocks) {
+        for (auto &inst : block->instructions) {
+            for (auto op : inst->operands())
+                *op = sets.rename(*op);
+
+            if (auto res = inst->result())
+                *res = sets.rename(*res);
+        }
+
+        for (auto op : block->blockTransfer->operands())
+            *op = sets.rename(*op);
+
+        std::erase_if(block->instructions, [&](const std::unique_ptr<IROp> &inst) {
+            auto asn = dynamic_cast<Assign *>(inst.get());
+            bool redundant = asn && sameValue(asn->dest, asn->src);
+
+            coalesced += redundant;
+            return redundant;
+        });
+    }
+
+    std::map<std::string, BasicBlock *> byLabel;
+    for (auto &block : blocks)
+        byLabel[block->label] = block.get();
+
+    for (auto &block : blocks) {
+        if (block->blockPhi.empty())
+            continue;
+
+        // one parallel copy per incoming edge
+        std::map<BasicBlock *, std::vector<std::pair<ValPtr, ValPtr>>> copies;
+
+        for (auto &phi : block->blockPhi) {
+            auto dest = sets.rename(std::make_shared<Local>(phi->outputVar, phi->resultVersion));
+
+            for (auto &[label, val] : phi->incoming) {
+                auto src = sets.rename(val);
+
+                if (sameValue(dest, src))
+                    coalesced++;
+                else
+                    copies[byLabel.at(label)].push_back({dest, src});
+            }
+        }
+
+        removedPhis += block->blockPhi.size();
+        block->blockPhi.clear();
+
+        for (auto &[pred, parallel] : copies) {
+            auto seq = sequentialize(std::move(parallel), *this);
+            inserted += seq.size();
+
+            // with critical edges split, either the predecessor only leads here or this block has no other way in
+            if (pred->getNextBlocks().size() == 1)
+                pred->instructions.insert(pred->instructions.end(), std::make_move_iterator(seq.begin()), std::make_move_iterator(seq.end()));
+            else
+                block->instructions.insert(block->instructions.begin(), std::make_move_iterator(seq.begin()), std::make_move_iterator(seq.end()));
+        }
+    }
+
+    // a loop whose test sits at the bottom would pay a jump through the split block on every iteration,
+    // so copies move up into the branching block wherever nothing they write is live on its other edge
+    // moving them only adds uses of values already live out of the branch, so liveness elsewhere can only shrink
+    keepAnalyses(Predecessors | Dominators);
+    requireAnalyses(Liveness);
+
+    for (auto split : splits) {
+        auto pred = *split->predecessors.begin();
+        auto cond = dynamic_cast<Conditional *>(pred->blockTransfer.get());
+        auto succ = split->getNextBlocks()[0];
+
+        if (!cond || cond->trueTarget == cond->falseTarget)
+            continue;
+
+        // leaving a loop from its latch, hoisted copies would run on every iteration instead of once
+        auto other = cond->trueTarget == split ? cond->falseTarget : cond->trueTarget;
+        if (other == succ || pred->dominatedBy(other))
+            continue;
+
+        bool safe = std::all_of(split->instructions.begin(), split->instructions.end(), [&](const std::unique_ptr<IROp> &inst) {
+            auto dest = asLocal(*inst->result());
+            return !other->liveIn.contains(valueKey(*dest)) && !sameValue(cond->condition, *inst->result());
+        });
+
+        if (safe)
+            hoistIntoPredecessor(split);
+    }
+
+    if (stats) {
+        stats->phisRemoved += removedPhis;
+        stats->copiesCoalesced += coalesced;
+        stats->copiesInserted += inserted;
+    }
+}
@@ -0,0 +1,250 @@
+#include "passmanager.h"
+#include "passstats.h"
+
+#include <stdexcept>
+#include <stdlib.h>
+
+const std::vector<PassInfo> &registeredPasses() {
+    static const std::vector<PassInfo> passes = {
+        {"simplifycfg", "merging of straight-line blocks and removal of empty and unreachable ones",
+            Predecessors, Predecessors, false, false,
+            [](MethodIR &m, const CompileBudget &) { m.simplifyCFG(); }},
+
+        {"ssa", "SSA construction with phis at every join on the dominance frontier",
+            DominanceFrontiers, CFGAnalyses, false, true,
+            [](MethodIR &m, const CompileBudget &) { m.convertSSA(); }},
+
+        // liveness is skipped on large methods at the cost of extra phis
+        {"pruned-ssa", "SSA construction with phis only where the variable is live",
+            DominanceFrontiers | Liveness, CFGAnalyses, false, true,
+            [](MethodIR &m, const CompileBudget &) { m.convertSSA(true); }, "ssa"},
+
+        {"vn", "value numbering within each block",
+            0, CFGAnalyses, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.valueNumberingPass(); }},
+
+        // rewrites uses of redundant values through the def-use chains instead of leaving copies behind
+        {"gvn", "value numbering across blocks along the dominator tree",
+            Dominators | DefUses, CFGAnalyses | DefUses, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.globalValueNumbering(); }, "vn"},
+
+        // edge splits keep the CFG analyses, the new phis and instructions are missing from the def-use chains
+        // its dataflow grows with blocks times expressions, so large methods go without
+        {"pre", "partial redundancy elimination by lazy code motion",
+            Predecessors | Dominators, Predecessors | Dominators, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.eliminatePartialRedundancies(); }, nullptr, false, true},
+
+        // copies and new phis leave the dominator tree behind
+        {"jumpthread", "threading of edges that decide a branch straight to the successor it picks",
+            Predecessors | Dominators, Predecessors, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.threadJumps(); }},
+
+        // copies of loops and the tests moved in front of them leave no analysis valid
+        {"unswitch", "hoisting of loop-invariant branches out of loops, with a copy of the loop for each way",
+            Predecessors | Dominators | Loops, 0, true, false,
+            [](MethodIR &m, const CompileBudget &b) { m.unswitchLoops(b.unswitchSize); }},
+
+        // the copies replace the loop's blocks, so nothing about the CFG survives
+        {"unroll", "copying of loop bodies with a constant trip count, completely or by the unroll factor",
+            Predecessors | Dominators | Loops, 0, true, false,
+            [](MethodIR &m, const CompileBudget &b) { m.unrollLoops(b.unrollSize, b.unrollFactor); }},
+
+        // new instructions are not threaded into the def-use chains
+        {"strength", "replacement of multiplications by constants with additions and induction variable sums",
+            Predecessors | Dominators | DefUses | Loops, CFGAnalyses, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.reduceStrength(); }},
+
+        {"copyprop", "replacement of every copied variable by its source",
+            DefUses, CFGAnalyses | DefUses, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.copyPropagation(); }},
+
+        {"dce", "removal of pure instructions and phis whose results are never used",
+            DefUses, CFGAnalyses | DefUses, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.deadCodeElimination(); }},
+
+        // splits critical edges, which keeps the dominator tree but not the frontiers
+        {"out-of-ssa", "replacement of phis by copies, coalescing values that never overlap",
+            Predecessors | Dominators, Predecessors | Dominators, true, false,
+            [](MethodIR &m, const CompileBudget &) { m.destructSSA(); }, nullptr, true},
+
+        // temporaries written more than once break the def-use chains SSA passes rely on
+        {"reuse-temps", "renaming of temporaries that are never live at once onto shared names",
+            Liveness, CFGAnalyses, false, false,
+            [](MethodIR &m, const CompileBudget &) { m.reuseTemps(); }, nullptr, true},
+    };
+
+    return passes;
+}
+
+static const PassInfo *findPass(std::string_view name) {
+    for (auto &pass : registeredPasses())
+        if (name == pass.name)
+            return &pass;
+
+    return nullptr;
+}
+
+int CompileBudget::tier(const MethodSize &size) const {
+    if (!enabled)
+        return 0;
+
+    auto over = [&](size_t factor) {
+        return size.blocks > blocks * factor || size.instructions > instructions * factor ||
+            size.variables > variables * factor;
+    };
+
+    return over(hardFactor) ? 2 : over(1) ? 1 : 0;
+}
+
+bool CompileBudget::parse(std::string_view spec) {
+    if (spec == "none") {
+        enabled = false;
+        return true;
+    }
+
+    enabled = true;
+
+    while (!spec.empty()) {
+        auto comma = spec.find(',');
+        auto item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? "" : spec.substr(comma + 1);
+
+        auto colon = item.find(':');
+        if (colon == std::string_view::npos)
+            return false;
+
+        auto key = item.substr(0, colon);
+        auto value = std::string(item.substr(colon + 1));
+
+        char *end;
+        size_t n = strtoul(value.c_str(), &end, 10);
+        if (value.empty() || *end)
+            return false;
+
+        if (key == "blocks")
+            blocks = n;
+        else if (key == "insts")
+            instructions = n;
+        else if (key == "vars")
+            variables = n;
+        else if (key == "unroll")
+            unrollSize = n;
+        else if (key == "factor")
+            unrollFactor = n;
+        else if (key == "unswitch")
+            unswitchSize = n;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+std::string CompileBudget::describe() const {
+    auto loops = ",unroll:" + std::to_string(unrollSize) + ",factor:" + std::to_string(unrollFactor) +
+        ",unswitch:" + std::to_string(unswitchSize);
+
+    if (!enabled)
+        return "none" + loops;
+
+    return "blocks:" + std::to_string(blocks) + ",insts:" + std::to_string(instructions) +
+        ",vars:" + std::to_string(variables) + loops;
+}
+
+PassManager::PassManager(std::string_view passes) {
+    bool inSSA = false;
+    bool builtSSA = false;
+
+    while (!passes.empty()) {
+        auto comma = passes.find(',');
+        auto name = passes.substr(0, comma);
+        passes = comma == std::string_view::npos ? "" : passes.substr(comma + 1);
+
+        if (name.empty())
+            continue;
+
+        auto info = findPass(name);
+
+        if (!info)
+            throw std::runtime_error("Unknown pass '" + std::string(name) + "'");
+
+        if (info->needsSSA && !inSSA)
+            throw std::runtime_error("Pass '" + std::string(name) + "' needs SSA form, run ssa or pruned-ssa before it");
+
+        // versions left after leaving SSA would be renamed as one variable
+        if (info->buildsSSA && builtSSA)
+            throw std::runtime_error("Pass '" + std::string(name) + "' needs a method that has not been in SSA form");
+
+        builtSSA |= info->buildsSSA;
+        inSSA = (inSSA || info->buildsSSA) && !info->leavesSSA;
+        pipeline.push_back(info);
+    }
+}
+
+std::string PassManager::preset(int level) {
+    switch (level) {
+        case 0: return "";
+        case 1: return "ssa,vn";
+        case 2: return "simplifycfg,pruned-ssa,gvn,pre,jumpthread,unswitch,unroll,strength,dce,simplifycfg,reuse-temps";
+        default: return "simplifycfg,pruned-ssa,gvn,pre,jumpthread,unswitch,unroll,strength,dce,simplifycfg,out-of-ssa,reuse-temps";
+    }
+}
+
+void PassManager::run(MethodIR &method) const {
+    auto size = method.measure();
+    int tier = budget.tier(size);
+
+    // every change the budget made to this method's pipeline, for -stats
+    std::string decisions;
+    bool inSSA = false;
+
+    for (auto planned : pipeline) {
+        auto pass = planned;
+
+        if (tier == 2 && pass->buildsSSA)
+            pass = nullptr;
+        else if (tier >= 1 && pass->fallback)
+            pass = findPass(pass->fallback);
+        else if (tier >= 1 && pass->skippedOverBudget)
+            pass = nullptr;
+
+        // later passes that need SSA are dropped along with it
+        if (pass && pass->needsSSA && !inSSA)
+            pass = nullptr;
+
+        if (pass != planned)
+            decisions += std::string(decisions.empty() ? "" : ", ") + planned->name + " -> " + (pass ? pass->name : "skipped");
+
+        if (!pass)
+            continue;
+
+        // analyses are timed under their own names
+        method.requireAnalyses(pass->required);
+
+        {
+            PassTimer timer(pass->name, method.getName());
+            pass->run(method, budget);
+        }
+
+        method.keepAnalyses(pass->preserved);
+        inSSA = (inSSA || pass->buildsSSA) && !pass->leavesSSA;
+    }
+
+    auto stats = PassStats::active();
+
+    if (stats && !decisions.empty())
+        stats->budgetDecisions.push_back(method.getName() + " (" + std::to_string(size.blocks) + " blocks, " +
+            std::to_string(size.instructions) + " instructions, " + std::to_string(size.variables) + " variables): " + decisions);
+}
+
+std::string PassManager::describe() const {
+    std::string ret;
+
+    for (auto pass : pipeline) {
+        if (!ret.empty())
+            ret += ',';
+        ret += pass->name;
+    }
+
+    return ret;
+}
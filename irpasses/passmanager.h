@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ir.h"
+
+struct CompileBudget;
+
+// A transformation over one method, with the analyses it reads and the ones still valid after it runs
+struct PassInfo {
+    const char *name;
+    const char *description;
+
+    AnalysisSet required;
+    AnalysisSet preserved;
+
+    // passes that rely on every variable having a single definition must come after SSA construction
+    bool needsSSA;
+    bool buildsSSA;
+
+    void (*run)(MethodIR &method, const CompileBudget &budget);
+
+    // cheaper pass run instead on methods over the soft budget, null when the pass is never degraded
+    const char *fallback = nullptr;
+
+    // passes after this one see a method out of SSA form again
+    bool leavesSSA = false;
+
+    // dropped on methods over the soft budget, for passes with nothing cheaper to run instead
+    bool skippedOverBudget = false;
+};
+
+// Size limits above which expensive passes are degraded
+// Past the soft limits passes with a fallback run that instead and those marked skippedOverBudget do not run,
+// past hardFactor times the limits SSA is not built at all, since phi placement and renaming grow with blocks
+// times variables
+struct CompileBudget {
+    bool enabled = true;
+
+    size_t blocks = 500;
+    size_t instructions = 10000;
+    size_t variables = 5000;
+
+    size_t hardFactor = 4;
+
+    // instructions unrolling may add to a method per loop, and how many copies of the body a loop it cannot
+    // unroll completely gets, both applied whether or not the size limits are enabled
+    size_t unrollSize = 64;
+    size_t unrollFactor = 4;
+
+    // instructions unswitching may add to a method in all, each loop copied costing its size
+    size_t unswitchSize = 64;
+
+    // 0 within budget, 1 over the soft limits, 2 over the hard limits
+    int tier(const MethodSize &size) const;
+
+    // "blocks:N,insts:N,vars:N,unroll:N,factor:N,unswitch:N" with any subset of keys, or "none", returns false when malformed
+    bool parse(std::string_view spec);
+
+    std::string describe() const;
+};
+
+// every pass that can be named in a pipeline, in the order -help lists them
+const std::vector<PassInfo> &registeredPasses();
+
+// Ordered list of passes run over every method
+// Analyses are only computed when a pass requires one that is not valid, and after each pass the valid
+// set shrinks to what that pass preserves, so results are shared between passes until something invalidates them
+class PassManager {
+    std::vector<const PassInfo *> pipeline;
+
+public:
+    // comma separated pass names, unknown names and passes ordered before the SSA they need throw std::runtime_error
+    explicit PassManager(std::string_view passes);
+
+    CompileBudget budget;
+
+    // pass list for an optimization level between 0 and 3
+    static std::string preset(int level);
+
+    void run(MethodIR &method) const;
+
+    // the pipeline as a comma separated list, empty when no pass runs
+    std::string describe() const;
+};
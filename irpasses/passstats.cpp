@@ -0,0 +1,177 @@
+#include "passstats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static thread_local PassStats *current = nullptr;
+
+static double threadCPUSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peakRSSKB() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // linux reports ru_maxrss in kilobytes
+    return usage.ru_maxrss;
+}
+
+PassStats *PassStats::active() {
+    return current;
+}
+
+PassStats::Phase &PassStats::phase(std::string_view name) {
+    // few distinct phases, and the report keeps them in the order they first ran
+    for (auto &p : phases)
+        if (p.name == name)
+            return p;
+
+    phases.push_back(Phase{std::string(name)});
+    return phases.back();
+}
+
+void PassStats::printTimes(FILE *f) const {
+    double wall = 0, cpu = 0;
+    long rss = 0;
+
+    fprintf(f, "===-- pass execution timing report --===\n");
+    fprintf(f, "  %-12s %12s %12s %14s\n", "phase", "wall ms", "cpu ms", "peak rss KB");
+
+    for (auto &p : phases) {
+        fprintf(f, "  %-12s %12.3f %12.3f %14ld\n", p.name.c_str(), p.wallSeconds * 1e3, p.cpuSeconds * 1e3, p.peakRSS);
+        wall += p.wallSeconds;
+        cpu += p.cpuSeconds;
+        rss = std::max(rss, p.peakRSS);
+    }
+
+    fprintf(f, "  %-12s %12.3f %12.3f %14ld\n", "total", wall * 1e3, cpu * 1e3, rss);
+}
+
+void PassStats::printCounters(FILE *f) const {
+    fprintf(f, "===-- statistics --===\n");
+    fprintf(f, "  %10zu blocks        - basic blocks emitted\n", blocks);
+    fprintf(f, "  %10zu cfg-removed   - blocks merged, bypassed or unreachable\n", blocksRemoved);
+    fprintf(f, "  %10zu instructions  - instructions emitted, excluding phis\n", instructions);
+    fprintf(f, "  %10zu phis          - phis inserted by SSA construction\n", phis);
+    fprintf(f, "  %10zu vn-replaced   - instructions rewritten by value numbering\n", vnReplacements);
+    fprintf(f, "  %10zu pre-removed   - computations made redundant on every path by moving the expression\n", redundanciesRemoved);
+    fprintf(f, "  %10zu pre-moved     - expressions given new places by partial redundancy elimination\n", expressionsMoved);
+    fprintf(f, "  %10zu threaded      - branches skipped on edges where their outcome was known\n", jumpsThreaded);
+    fprintf(f, "  %10zu unswitched    - loop-invariant branches moved in front of a copy of their loop\n", loopsUnswitched);
+    fprintf(f, "  %10zu unrolled      - loops copied out completely or by the unroll factor\n", loopsUnrolled);
+    fprintf(f, "  %10zu strength      - multiplications and divisions replaced by additions or running sums\n", strengthReduced);
+    fprintf(f, "  %10zu dce-removed   - dead instructions and phis removed\n", deadRemoved);
+    fprintf(f, "  %10zu copies        - copies removed by copy propagation\n", copiesPropagated);
+    fprintf(f, "  %10zu phis-removed  - phis replaced by copies leaving SSA\n", phisRemoved);
+    fprintf(f, "  %10zu coalesced     - phi arguments and copies whose values were given one name\n", copiesCoalesced);
+    fprintf(f, "  %10zu copies-added  - copies placed on incoming edges leaving SSA\n", copiesInserted);
+    fprintf(f, "  %10zu temps         - temporaries created while lowering\n", temps);
+    fprintf(f, "  %10zu temps-reused  - temporaries renamed onto the name of one never live at the same time\n", tempsReused);
+
+    LoopCounts loopTotal;
+    for (auto &[_, counts] : loopCounts) {
+        loopTotal.loops += counts.loops;
+        loopTotal.inductions += counts.inductions;
+        loopTotal.tripCounts += counts.tripCounts;
+        loopTotal.constantTrips += counts.constantTrips;
+    }
+
+    fprintf(f, "  %10zu loops         - natural loops found by the last loop analysis of each method\n", loopTotal.loops);
+    fprintf(f, "  %10zu loop-ivs      - basic and derived induction variables of those loops\n", loopTotal.inductions);
+    fprintf(f, "  %10zu trip-counts   - loops whose number of iterations is known on entry\n", loopTotal.tripCounts);
+    fprintf(f, "  %10zu trip-consts   - loops among them that always run the same number of times\n", loopTotal.constantTrips);
+
+    if (cacheHits)
+        fprintf(f, "  %10zu cache-hits    - methods reused from the IR cache\n", cacheHits);
+
+    fprintf(f, "  %10zu over-budget   - methods whose passes were degraded by the compile budget\n", budgetDecisions.size());
+
+    for (auto &decision : budgetDecisions)
+        fprintf(f, "    %s\n", decision.c_str());
+}
+
+static void writeJSONString(std::ofstream &out, const std::string &s) {
+    out << '"';
+
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+
+    out << '"';
+}
+
+void PassStats::writeTrace(const std::string &path) const {
+    std::ofstream out(path);
+
+    if (!out.is_open())
+        throw std::runtime_error("Could not open trace file '" + path + "'");
+
+    auto pid = getpid();
+
+    // microseconds to the nanosecond, the default six significant digits turn late timestamps into exponents
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\": [\n";
+
+    for (size_t i = 0; i < events.size(); i++) {
+        auto &e = events[i];
+
+        out << "  {\"name\": ";
+        writeJSONString(out, e.name);
+        out << ", \"cat\": ";
+        writeJSONString(out, e.category);
+        out << ", \"ph\": \"X\", \"ts\": " << e.startMicros << ", \"dur\": " << e.durationMicros
+            << ", \"pid\": " << pid << ", \"tid\": 1}" << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+
+    out << "], \"displayTimeUnit\": \"ms\"}\n";
+
+    if (!out)
+        throw std::runtime_error("Could not write trace file '" + path + "'");
+}
+
+ActiveStats::ActiveStats(PassStats *stats): previous(current) {
+    current = stats;
+}
+
+ActiveStats::~ActiveStats() {
+    current = previous;
+}
+
+PassTimer::PassTimer(const char *phaseName, std::string methodName):
+    stats(current), phase(phaseName), method(std::move(methodName)) {
+        if (!stats)
+            return;
+
+        wallStart = PassStats::Clock::now();
+        cpuStart = threadCPUSeconds();
+    }
+
+PassTimer::~PassTimer() {
+    if (!stats)
+        return;
+
+    auto wallEnd = PassStats::Clock::now();
+    std::chrono::duration<double> wall = wallEnd - wallStart;
+
+    auto &p = stats->phase(phase);
+    p.wallSeconds += wall.count();
+    p.cpuSeconds += threadCPUSeconds() - cpuStart;
+    p.peakRSS = peakRSSKB();
+
+    if (stats->tracing) {
+        std::chrono::duration<double, std::micro> start = wallStart - stats->epoch;
+        std::chrono::duration<double, std::micro> dur = wallEnd - wallStart;
+
+        stats->events.push_back({method.empty() ? phase : method, phase, start.count(), dur.count()});
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+
+// Counters, phase timings and trace events collected while compiling one program
+// Passes find the collector through PassStats::active(), which is null unless the driver asked for
+// statistics, so instrumented code costs one thread local load when nothing is being recorded
+struct PassStats {
+    using Clock = std::chrono::steady_clock;
+
+    // totals for one named phase, summed over every method it ran on
+    struct Phase {
+        std::string name;
+        double wallSeconds = 0;
+        double cpuSeconds = 0;
+
+        // high water mark of the whole process when the phase last finished, in KB
+        long peakRSS = 0;
+    };
+
+    // one complete span, emitted as a chrome trace "X" event
+    struct Event {
+        std::string name;
+        std::string category;
+        double startMicros;
+        double durationMicros;
+    };
+
+    size_t blocks = 0;
+    size_t blocksRemoved = 0;
+    size_t instructions = 0;
+    size_t phis = 0;
+    size_t vnReplacements = 0;
+    size_t redundanciesRemoved = 0;
+    size_t expressionsMoved = 0;
+    size_t jumpsThreaded = 0;
+    size_t loopsUnswitched = 0;
+    size_t loopsUnrolled = 0;
+    size_t strengthReduced = 0;
+    size_t deadRemoved = 0;
+    size_t copiesPropagated = 0;
+    size_t phisRemoved = 0;
+    size_t copiesCoalesced = 0;
+    size_t copiesInserted = 0;
+    size_t temps = 0;
+    size_t tempsReused = 0;
+    size_t cacheHits = 0;
+
+    // what the last loop analysis of each method found, by method, so recomputing it between passes does not count twice
+    struct LoopCounts {
+        size_t loops = 0;
+        size_t inductions = 0;
+        size_t tripCounts = 0;
+        size_t constantTrips = 0;
+    };
+
+    std::map<std::string, LoopCounts> loopCounts;
+
+    std::vector<Phase> phases;
+
+    // one line for every method whose pipeline the compile budget changed
+    std::vector<std::string> budgetDecisions;
+
+    bool tracing = false;
+    std::vector<Event> events;
+
+    Clock::time_point epoch = Clock::now();
+
+    Phase &phase(std::string_view name);
+
+    // stats of the compile running on this thread, or null
+    static PassStats *active();
+
+    void printTimes(FILE *f) const;
+    void printCounters(FILE *f) const;
+
+    // chrome trace event format, loadable in chrome://tracing or perfetto
+    void writeTrace(const std::string &path) const;
+};
+
+// makes stats the active collector on this thread until destroyed
+class ActiveStats {
+    PassStats *previous;
+
+public:
+    explicit ActiveStats(PassStats *stats);
+    ~ActiveStats();
+};
+
+// times a phase from construction to destruction and adds it to the active collector
+// with a method name the span is traced as that method inside the phase's category
+class PassTimer {
+    PassStats *stats;
+    const char *phase;
+    std::string method;
+
+    PassStats::Clock::time_point wallStart;
+    double cpuStart;
+
+public:
+    explicit PassTimer(const char *phaseName, std::string methodName = "");
+    ~PassTimer();
+
+    PassTimer(const PassTimer &) = delete;
+    PassTimer &operator=(const PassTimer &) = delete;
+};
@@ -0,0 +1,403 @@
+// pre.cpp : partial redundancy elimination by lazy code motion, moving computations onto the edges where they
+//           are missing so later ones are redundant on every path, and no path computes anything more than before
+#include "ir.h"
+#include "passstats.h"
+#include "ssaupdater.h"
+
+#include <algorithm>
+#include <bit>
+#include <map>
+#include <unordered_map>
+
+// computations that can fault would fault earlier once moved, ahead of whatever the program did first
+static bool cannotFault(const BinInst *bin) {
+    auto divisor = asConst(bin->rhs);
+    return bin->op != Oper::Div || (divisor && divisor->value != 0);
+}
+
+static std::string operandKey(const ValPtr &v) {
+    auto lcl = asLocal(v);
+    return lcl ? valueKey(*lcl) : std::to_string(v->getValType()) + v->getString();
+}
+
+static bool commutative(Oper op) {
+    return op == Oper::Add || op == Oper::Mul || op == Oper::BitOr || op == Oper::BitAnd ||
+        op == Oper::BitXor || op == Oper::Eq || op == Oper::Ne;
+}
+
+// operator and operands of a computation, those of commutative operators in a fixed order
+static std::string expressionKey(const BinInst *bin) {
+    auto l = operandKey(bin->lhs);
+    auto r = operandKey(bin->rhs);
+
+    if (commutative(bin->op) && r < l)
+        std::swap(l, r);
+
+    return std::to_string((int) bin->op) + "|" + l + "|" + r;
+}
+
+// one bit per expression, so each dataflow step below works on 64 expressions at a time
+using ExprBits = std::vector<unsigned long>;
+
+// what one block does with every expression
+// in SSA an operand is only written by its definition, so the block defining one is the only one that kills it
+struct LocalProperties {
+    ExprBits antloc;
+    ExprBits comp;
+    ExprBits transp;
+
+    // by expression, the computation reached from the start of the block and the one whose value reaches its end
+    std::unordered_map<size_t, BinInst *> first;
+    std::unordered_map<size_t, BinInst *> last;
+};
+
+// Every expression is placed at once, for a method whose start block has no way back into it, in four
+// dataflow passes: available and anticipated (computed on every path to or from a point), then earliest,
+// the edges where it is anticipated but not yet available, then later, how far it can sink from there
+// without being needed first. It goes on the edges where it cannot sink further, and the first computation
+// of every block it already reaches is deleted.
+void MethodIR::eliminatePartialRedundancies() {
+    requireAnalyses(Predecessors | Dominators);
+
+    // a start block that can be reached again would need somewhere to insert in front of it
+    if (!getStartBlock()->predecessors.empty())
+        return;
+
+    size_t n = blocks.size();
+
+    // the first computation of every expression, deleted ones stay alive until the end of the pass
+    // constant ones stay where they are, moved into a variable they would hide a test or a trip count from folding
+    // addresses stay too, a call or an allocation between a moved one and its use could let the collector move the object
+    std::vector<BinInst *> models;
+    std::unordered_map<std::string, size_t> exprIndex;
+    std::unordered_map<const BinInst *, size_t> exprOf;
+
+    auto addresses = addressValues();
+
+    for (auto &block : blocks) {
+        for (auto &inst : block->instructions) {
+            auto bin = dynamic_cast<BinInst *>(inst.get());
+
+            if (!bin || !asLocal(bin->dest) || !(asLocal(bin->lhs) || asLocal(bin->rhs)) || !cannotFault(bin))
+                continue;
+
+            if (addresses.contains(valueKey(*asLocal(bin->dest))))
+                continue;
+
+            auto [it, added] = exprIndex.try_emplace(expressionKey(bin), models.size());
+            if (added)
+                models.push_back(bin);
+
+            exprOf[bin] = it->second;
+        }
+    }
+
+    if (models.empty())
+        return;
+
+    size_t exprs = models.size();
+    size_t words = (exprs + 63) / 64;
+
+    ExprBits none(words, 0);
+    ExprBits all(words, ~0UL);
+    if (exprs % 64)
+        all.back() = (1UL << (exprs % 64)) - 1;
+
+    // the expressions reading each value, all killed where it is defined
+    std::unordered_map<std::string, std::vector<size_t>> readers;
+
+    for (size_t e = 0; e < exprs; e++) {
+        for (auto v : {models[e]->lhs, models[e]->rhs}) {
+            auto lcl = asLocal(v);
+            if (!lcl)
+                continue;
+
+            // x + x reads its operand twice
+            auto &list = readers[valueKey(*lcl)];
+            if (list.empty() || list.back() != e)
+                list.push_back(e);
+        }
+    }
+
+    std::unordered_map<const BasicBlock *, size_t> index;
+    for (size_t i = 0; i < n; i++)
+        index[blocks[i].get()] = i;
+
+    std::vector<LocalProperties> local(n);
+
+    for (size_t b = 0; b < n; b++) {
+        auto &props = local[b];
+        props.antloc = none;
+        props.comp = none;
+        props.transp = all;
+
+        auto kill = [&](const std::string &defined) {
+            auto it = readers.find(defined);
+            if (it == readers.end())
+                return;
+
+            for (auto e : it->second) {
+                props.transp[e / 64] &= ~(1UL << (e % 64));
+                props.comp[e / 64] &= ~(1UL << (e % 64));
+                props.last.erase(e);
+            }
+        };
+
+        for (auto &phi : blocks[b]->blockPhi)
+            kill(valueKey(Local(phi->outputVar, phi->resultVersion)));
+
+        for (auto &inst : blocks[b]->instructions) {
+            if (auto it = exprOf.find(dynamic_cast<BinInst *>(inst.get())); it != exprOf.end()) {
+                auto e = it->second;
+                auto bit = 1UL << (e % 64);
+
+                if ((props.transp[e / 64] & bit) && !props.first.contains(e)) {
+                    props.antloc[e / 64] |= bit;
+                    props.first[e] = static_cast<BinInst *>(inst.get());
+                }
+
+                props.comp[e / 64] |= bit;
+                props.last[e] = static_cast<BinInst *>(inst.get());
+            }
+
+            if (auto res = inst->result(); res && asLocal(*res))
+                kill(valueKey(*asLocal(*res)));
+        }
+    }
+
+    std::vector<std::vector<size_t>> preds(n), succs(n);
+
+    for (size_t b = 0; b < n; b++) {
+        auto next = blocks[b]->getNextBlocks();
+
+        for (auto succ : std::set<BasicBlock *>(next.begin(), next.end())) {
+            succs[b].push_back(index.at(succ));
+            preds[index.at(succ)].push_back(b);
+        }
+    }
+
+    // a loop that never ends has no path to the end that computes the expression, but nothing would say so
+    std::vector<bool> ends(n, false);
+    std::vector<size_t> work;
+
+    for (size_t b = 0; b < n; b++)
+        if (succs[b].empty())
+            work.push_back(b);
+
+    while (!work.empty()) {
+        auto b = work.back();
+        work.pop_back();
+
+        if (ends[b])
+            continue;
+
+        ends[b] = true;
+        work.insert(work.end(), preds[b].begin(), preds[b].end());
+    }
+
+    // available on every path from the start, then anticipated on every path to the end
+    std::vector<ExprBits> avIn(n, none), avOut(n, all);
+    std::vector<ExprBits> antIn(n, none), antOut(n, none);
+
+    for (size_t b = 0; b < n; b++)
+        if (ends[b])
+            antIn[b] = antOut[b] = all;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (size_t b = 0; b < n; b++) {
+            for (size_t k = 0; k < words; k++) {
+                unsigned long in = preds[b].empty() || b == 0 ? 0 : ~0UL;
+                for (auto p : preds[b])
+                    in &= avOut[p][k];
+
+                unsigned long out = local[b].comp[k] | (in & local[b].transp[k]);
+                changed = changed || in != avIn[b][k] || out != avOut[b][k];
+                avIn[b][k] = in;
+                avOut[b][k] = out;
+            }
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (size_t b = n; b-- > 0;) {
+            if (!ends[b])
+                continue;
+
+            for (size_t k = 0; k < words; k++) {
+                unsigned long out = succs[b].empty() ? 0 : ~0UL;
+                for (auto s : succs[b])
+                    out &= antIn[s][k];
+
+                unsigned long in = local[b].antloc[k] | (out & local[b].transp[k]);
+                changed = changed || in != antIn[b][k] || out != antOut[b][k];
+                antIn[b][k] = in;
+                antOut[b][k] = out;
+            }
+        }
+    }
+
+    auto earliest = [&](size_t i, size_t j, size_t k) {
+        return antIn[j][k] & ~avOut[i][k] & (~local[i].transp[k] | ~antOut[i][k]);
+    };
+
+    // the start block is entered once from outside the method, where an expression is always earliest if anticipated
+    std::vector<ExprBits> laterIn(n, all);
+    laterIn[0] = antIn[0];
+
+    auto later = [&](size_t i, size_t j, size_t k) {
+        return earliest(i, j, k) | (laterIn[i][k] & ~local[i].antloc[k]);
+    };
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (size_t b = 1; b < n; b++) {
+            for (size_t k = 0; k < words; k++) {
+                unsigned long in = preds[b].empty() ? 0 : ~0UL;
+                for (auto p : preds[b])
+                    in &= later(p, b, k);
+
+                changed = changed || in != laterIn[b][k];
+                laterIn[b][k] = in;
+            }
+        }
+    }
+
+    // every expression set in a word, lowest first
+    auto each = [](unsigned long bits, size_t k, auto &&visit) {
+        for (; bits; bits &= bits - 1)
+            visit(k * 64 + std::countr_zero(bits));
+    };
+
+    std::vector<std::vector<std::pair<size_t, size_t>>> inserts(exprs);
+    std::vector<std::vector<size_t>> deletes(exprs);
+
+    for (size_t i = 0; i < n; i++)
+        for (auto j : succs[i])
+            for (size_t k = 0; k < words; k++)
+                each(later(i, j, k) & ~laterIn[j][k], k, [&](size_t e) { inserts[e].push_back({i, j}); });
+
+    for (size_t b = 0; b < n; b++)
+        for (size_t k = 0; k < words; k++)
+            each(local[b].antloc[k] & ~laterIn[b][k], k, [&](size_t e) { deletes[e].push_back(b); });
+
+    // a split edge costs a jump every time it is taken, which only pays off in front of a loop
+    auto header = [&](size_t j) {
+        auto &in = blocks[j]->predecessors;
+        return std::any_of(in.begin(), in.end(), [&](BasicBlock *pred) { return pred->dominatedBy(blocks[j].get()); });
+    };
+
+    std::vector<bool> moves(exprs);
+
+    for (size_t e = 0; e < exprs; e++)
+        moves[e] = !deletes[e].empty() && std::all_of(inserts[e].begin(), inserts[e].end(), [&](auto edge) {
+            return blocks[edge.first]->getNextBlocks().size() == 1 || header(edge.second);
+        });
+
+    // blocks are only added from here on, and edges split for one expression are shared by the rest
+    std::vector<BasicBlock *> origin(n);
+    for (size_t b = 0; b < n; b++)
+        origin[b] = blocks[b].get();
+
+    std::map<std::pair<size_t, size_t>, BasicBlock *> splits;
+    std::vector<std::pair<BinInst *, ValPtr>> deleted;
+    size_t moved = 0;
+
+    for (size_t e = 0; e < exprs; e++) {
+        if (!moves[e])
+            continue;
+
+        auto model = models[e];
+
+        // every computation of the expression, moved or not, defines one variable whose value the deleted ones read
+        auto var = newTemp()->name;
+        std::vector<std::pair<BasicBlock *, ValPtr>> defs;
+
+        for (auto [i, j] : inserts[e]) {
+            auto at = origin[i];
+
+            if (at->getNextBlocks().size() != 1) {
+                auto &split = splits[{i, j}];
+                if (!split)
+                    split = splitEdge(origin[i], origin[j]);
+
+                at = split;
+            }
+
+            auto tmp = newTemp();
+            at->instructions.push_back(std::make_unique<BinInst>(tmp, model->op, model->lhs, model->rhs));
+            defs.push_back({at, tmp});
+        }
+
+        for (size_t b = 0; b < n; b++) {
+            auto last = local[b].last.find(e);
+            if (last == local[b].last.end())
+                continue;
+
+            bool gone = std::find(deletes[e].begin(), deletes[e].end(), b) != deletes[e].end();
+
+            if (!(gone && last->second == local[b].first.at(e)))
+                defs.push_back({origin[b], last->second->dest});
+        }
+
+        // the updater revisits the slots it filled when a phi it placed folds away, so they stay put until it is done
+        std::vector<ValPtr> reaching(deletes[e].size());
+
+        {
+            SSAUpdater updater(*this, var);
+            for (auto &[block, value] : defs)
+                updater.addDefinition(block, value);
+
+            for (size_t k = 0; k < deletes[e].size(); k++)
+                updater.rewriteUse(&reaching[k], origin[deletes[e][k]]);
+        }
+
+        for (size_t k = 0; k < deletes[e].size(); k++)
+            deleted.push_back({local[deletes[e][k]].first.at(e), reaching[k]});
+
+        moved++;
+    }
+
+    // deleted computations become the value reaching them, which may itself be one deleted later
+    std::unordered_map<std::string, ValPtr> forward;
+    for (auto &[bin, value] : deleted)
+        forward[valueKey(*asLocal(bin->dest))] = value;
+
+    auto resolve = [&](ValPtr v) {
+        for (auto lcl = asLocal(v); lcl && forward.contains(valueKey(*lcl)); lcl = asLocal(v))
+            v = forward.at(valueKey(*lcl));
+
+        return v;
+    };
+
+    std::set<IROp *> erased;
+    for (auto &[bin, _] : deleted)
+        erased.insert(bin);
+
+    for (auto &block : blocks) {
+        for (auto &phi : block->blockPhi)
+            for (auto &[_, val] : phi->incoming)
+                val = resolve(val);
+
+        std::erase_if(block->instructions, [&](const std::unique_ptr<IROp> &inst) { return erased.contains(inst.get()); });
+
+        for (auto &inst : block->instructions)
+            for (auto slot : inst->operands())
+                *slot = resolve(*slot);
+
+        for (auto slot : block->blockTransfer->operands())
+            *slot = resolve(*slot);
+    }
+
+    // edge splits keep the CFG analyses, the new phis and instructions are missing from everything else
+    keepAnalyses(Predecessors | Dominators);
+
+    if (auto stats = PassStats::active()) {
+        stats->redundanciesRemoved += deleted.size();
+        stats->expressionsMoved += moved;
+    }
+}
@@ -0,0 +1,183 @@
+// reusetemps.cpp : gives temporaries that are never live at once the same name
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+void MethodIR::reuseTemps() {
+    requireAnalyses(Liveness);
+
+    // temporaries are found by key, every other value is left as it is
+    std::unordered_map<std::string, int> index;
+    for (auto &tmp : temps)
+        index.try_emplace(valueKey(Local(tmp, 0, true)), index.size());
+
+    auto node = [&](const ValPtr &v) {
+        auto lcl = dynamic_cast<Local *>(v.get());
+        auto it = lcl ? index.find(valueKey(*lcl)) : index.end();
+        return it == index.end() ? -1 : it->second;
+    };
+
+    std::vector<std::vector<int>> adjacent(index.size());
+    std::unordered_set<long long> edges;
+
+    auto interfere = [&](int a, int b) {
+        if (a == b || !edges.insert(a < b ? (long long) a << 32 | b : (long long) b << 32 | a).second)
+            return;
+
+        adjacent[a].push_back(b);
+        adjacent[b].push_back(a);
+    };
+
+    // a temporary written by a copy of another would rather share its name, so the copy can go
+    std::vector<int> hint(index.size(), -1);
+
+    // colored in the order temporaries first appear, which keeps names stable between compiles
+    std::vector<int> order;
+    std::vector<bool> seen(index.size());
+
+    auto appear = [&](int t) {
+        if (t != -1 && !seen[t]) {
+            seen[t] = true;
+            order.push_back(t);
+        }
+    };
+
+    // a temporary interferes with every temporary live where it is written, walking each block backwards
+    for (auto &block : blocks) {
+        std::vector<int> live;
+        std::vector<bool> isLive(index.size());
+
+        for (auto &key : block->liveOut)
+            if (auto it = index.find(key); it != index.end()) {
+                live.push_back(it->second);
+                isLive[it->second] = true;
+            }
+
+        auto use = [&](const ValPtr &v) {
+            if (int t = node(v); t != -1 && !isLive[t]) {
+                live.push_back(t);
+                isLive[t] = true;
+            }
+        };
+
+        for (auto op : block->blockTransfer->operands())
+            use(*op);
+
+        for (auto it = block->instructions.rbegin(); it != block->instructions.rend(); it++) {
+            auto inst = it->get();
+            auto res = inst->result();
+
+            if (int d = res ? node(*res) : -1; d != -1) {
+                auto asn = dynamic_cast<Assign *>(inst);
+                int src = asn ? node(asn->src) : -1;
+
+                // a copy and its source hold the same value, so sharing a name is safe while both are live
+                for (auto t : live)
+                    if (t != src)
+                        interfere(d, t);
+
+                if (src != -1)
+                    hint[d] = src;
+
+                if (isLive[d]) {
+                    isLive[d] = false;
+                    std::erase(live, d);
+                }
+            }
+
+            for (auto op : inst->operands())
+                use(*op);
+        }
+    }
+
+    for (auto &block : blocks) {
+        for (auto &phi : block->blockPhi)
+            for (auto op : phi->operands())
+                appear(node(*op));
+
+        for (auto &inst : block->instructions) {
+            for (auto op : inst->operands())
+                appear(node(*op));
+
+            if (auto res = inst->result())
+                appear(node(*res));
+        }
+
+        for (auto op : block->blockTransfer->operands())
+            appear(node(*op));
+    }
+
+    // greedy coloring, each temporary takes its copy source's name if free and otherwise the lowest free one
+    std::vector<int> color(index.size(), -1);
+
+    // takenBy[c] is t + 1 while coloring t if a neighbor of t already has color c
+    std::vector<int> takenBy(index.size() + 1);
+    int colors = 0;
+
+    for (auto t : order) {
+        for (auto n : adjacent[t])
+            if (color[n] != -1)
+                takenBy[color[n]] = t + 1;
+
+        if (int h = hint[t]; h != -1 && color[h] != -1 && takenBy[color[h]] != t + 1)
+            color[t] = color[h];
+        else {
+            int c = 0;
+            while (takenBy[c] == t + 1)
+                c++;
+
+            color[t] = c;
+            colors = std::max(colors, c + 1);
+        }
+    }
+
+    std::vector<ValPtr> names;
+    std::vector<std::string> reused;
+
+    for (int c = 0; c < colors; c++) {
+        reused.push_back("tmp" + std::to_string(c + 1));
+        names.push_back(std::make_shared<Local>(reused.back(), 0, true));
+    }
+
+    auto rename = [&](ValPtr *slot) {
+        if (int t = node(*slot); t != -1)
+            *slot = names[color[t]];
+    };
+
+    size_t removed = 0;
+
+    for (auto &block : blocks) {
+        for (auto &phi : block->blockPhi)
+            for (auto op : phi->operands())
+                rename(op);
+
+        for (auto &inst : block->instructions) {
+            for (auto op : inst->operands())
+                rename(op);
+
+            if (auto res = inst->result())
+                rename(res);
+        }
+
+        for (auto op : block->blockTransfer->operands())
+            rename(op);
+
+        std::erase_if(block->instructions, [&](const std::unique_ptr<IROp> &inst) {
+            auto asn = dynamic_cast<Assign *>(inst.get());
+            bool redundant = asn && asn->dest->ignoreSSA && sameValue(asn->dest, asn->src);
+
+            removed += redundant;
+            return redundant;
+        });
+    }
+
+    if (auto stats = PassStats::active()) {
+        stats->tempsReused += temps.size() - reused.size();
+        stats->copiesCoalesced += removed;
+    }
+
+    temps = std::move(reused);
+}
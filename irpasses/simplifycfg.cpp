@@ -0,0 +1,173 @@
+// simplifycfg.cpp : merges straight-line blocks, bypasses empty ones and drops unreachable ones until nothing changes
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// phi arguments coming in from one block come in from another instead
+static void relabelIncoming(BasicBlock *block, const std::string &from, const std::string &to) {
+    for (auto &phi : block->blockPhi)
+        for (auto &[label, _] : phi->incoming)
+            if (label == from)
+                label = to;
+}
+
+void MethodIR::simplifyCFG() {
+    requireAnalyses(Predecessors);
+
+    auto start = getStartBlock();
+    std::set<BasicBlock *> removed;
+    size_t blocksRemoved = 0;
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        // blocks merged or bypassed on the last round go first, they may have handed their terminator on
+        blocksRemoved += std::erase_if(blocks, [&](const std::unique_ptr<BasicBlock> &block) { return removed.contains(block.get()); });
+        removed.clear();
+
+        // then blocks not reachable from the start, and their phi arguments in reachable blocks
+        auto unreachable = removeUnreachableBlocks();
+        blocksRemoved += unreachable.size();
+        changed = !unreachable.empty();
+
+        // a phi with one way in is its argument, and dropping it can leave the block empty enough to bypass
+        std::unordered_map<std::string, ValPtr> forward;
+
+        for (auto &block : blocks) {
+            if (removed.contains(block.get()) || block->predecessors.size() != 1)
+                continue;
+
+            std::erase_if(block->blockPhi, [&](const std::unique_ptr<Phi> &phi) {
+                auto result = Local(phi->outputVar, phi->resultVersion);
+                auto &arg = phi->incoming.at(0).second;
+
+                if (phi->incoming.size() != 1 || sameValue(arg, std::make_shared<Local>(result)))
+                    return false;
+
+                forward[valueKey(result)] = arg;
+                return true;
+            });
+        }
+
+        if (!forward.empty()) {
+            changed = true;
+
+            auto rewrite = [&](ValPtr *slot) {
+                // an argument can itself be a forwarded phi, chains end within as many steps as there are phis
+                for (size_t steps = 0; steps <= forward.size(); steps++) {
+                    auto lcl = dynamic_cast<Local *>(slot->get());
+                    auto it = lcl ? forward.find(valueKey(*lcl)) : forward.end();
+
+                    if (it == forward.end())
+                        break;
+
+                    *slot = it->second;
+                }
+            };
+
+            for (auto &block : blocks) {
+                if (removed.contains(block.get()))
+                    continue;
+
+                for (auto &phi : block->blockPhi)
+                    for (auto op : phi->operands())
+                        rewrite(op);
+
+                for (auto &inst : block->instructions)
+                    for (auto op : inst->operands())
+                        rewrite(op);
+
+                for (auto op : block->blockTransfer->operands())
+                    rewrite(op);
+            }
+        }
+
+        for (auto &ptr : blocks) {
+            auto block = ptr.get();
+            if (removed.contains(block))
+                continue;
+
+            // both ways lead to the same block, so the test decides nothing
+            if (auto cond = dynamic_cast<Conditional *>(block->blockTransfer.get()); cond && cond->trueTarget == cond->falseTarget) {
+                block->blockTransfer = std::make_unique<Jump>(cond->trueTarget);
+                changed = true;
+            }
+
+            // swallow the successor while it is only entered from here, so whole chains merge in one visit
+            while (auto jmp = dynamic_cast<Jump *>(block->blockTransfer.get())) {
+                auto succ = jmp->target;
+
+                if (succ == block || succ == start || succ->predecessors.size() != 1)
+                    break;
+
+                // with one way in, each phi just copies its argument
+                for (auto &phi : succ->blockPhi)
+                    block->instructions.push_back(std::make_unique<Assign>(
+                        std::make_shared<Local>(phi->outputVar, phi->resultVersion), phi->incoming.at(0).second));
+
+                std::move(succ->instructions.begin(), succ->instructions.end(), std::back_inserter(block->instructions));
+                block->blockTransfer = std::move(succ->blockTransfer);
+
+                for (auto next : block->getNextBlocks()) {
+                    next->predecessors.erase(succ);
+                    next->predecessors.insert(block);
+                    relabelIncoming(next, succ->label, block->label);
+                }
+
+                removed.insert(succ);
+                changed = true;
+            }
+
+            // an empty block that only jumps on is bypassed by pointing its predecessors at the target
+            auto jmp = dynamic_cast<Jump *>(block->blockTransfer.get());
+
+            if (!jmp || block == start || !block->instructions.empty() || !block->blockPhi.empty() || jmp->target == block)
+                continue;
+
+            auto target = jmp->target;
+
+            auto argFrom = [](Phi *phi, BasicBlock *from) {
+                return std::find_if(phi->incoming.begin(), phi->incoming.end(), [&](auto &in) { return in.first == from->label; });
+            };
+
+            // a predecessor already leading to the target can only take the second edge if every phi gets the same value on both
+            bool conflict = std::any_of(block->predecessors.begin(), block->predecessors.end(), [&](BasicBlock *pred) {
+                return target->predecessors.contains(pred) && std::any_of(target->blockPhi.begin(), target->blockPhi.end(),
+                    [&](auto &phi) { return !sameValue(argFrom(phi.get(), pred)->second, argFrom(phi.get(), block)->second); });
+            });
+
+            if (conflict)
+                continue;
+
+            for (auto &phi : target->blockPhi) {
+                auto in = argFrom(phi.get(), block);
+                auto val = in->second;
+                phi->incoming.erase(in);
+
+                for (auto pred : block->predecessors)
+                    if (!target->predecessors.contains(pred))
+                        phi->incoming.push_back({pred->label, val});
+            }
+
+            for (auto pred : block->predecessors) {
+                pred->blockTransfer->replaceSuccessor(block, target);
+                target->predecessors.insert(pred);
+            }
+
+            target->predecessors.erase(block);
+            block->predecessors.clear();
+
+            removed.insert(block);
+            changed = true;
+        }
+    }
+
+    // a round that removes nothing ends the loop, so nothing is left to erase here
+    if (auto stats = PassStats::active())
+        stats->blocksRemoved += blocksRemoved;
+
+    keepAnalyses(Predecessors);
+}
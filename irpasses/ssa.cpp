@@ -1,4 +1,5 @@
 #include "ir.h"
+#include "passstats.h"
 #include <queue>
 #include <algorithm>
 
@@ -15,115 +16,140 @@ void MethodIR::computeBlockPredecessors() {
     for (auto& block : blocks)
         for (auto* succ : block->getNextBlocks()) 
             succ->predecessors.insert(block.get());
-}
-
-// get elements that are in all sets present in a vector
-// used to get all blocks that are in the dominator sets of predecessor blocks
-std::set<BasicBlock *> compoundIntersection(const std::vector<std::set<BasicBlock *>>& sets) {
-    if (sets.empty()) return {};
-
-    std::set<BasicBlock *> result = sets[0];
 
-    for (size_t i = 1; i < sets.size(); ++i) {
-        std::set<BasicBlock *> temp;
-        std::set_intersection(result.begin(), result.end(),
-                              sets[i].begin(), sets[i].end(),
-                              std::inserter(temp, temp.begin()));
+    validAnalyses |= Predecessors;
+}
 
-        result = std::move(temp);
-    }
+bool BasicBlock::dominatedBy(const BasicBlock *other) const {
+    for (auto runner = this; runner; runner = runner->immediateDominator)
+        if (runner == other)
+            return true;
 
-    return result;
+    return false;
 }
 
+// Cooper, Harvey and Kennedy's iterative algorithm: immediate dominators are refined over reverse postorder
+// until nothing changes, which takes two or three sweeps on reducible flow graphs
 void MethodIR::populateDominators() {
     // make sure to calculate block predecessors
-    computeBlockPredecessors();
+    requireAnalyses(Predecessors);
 
-    int numblocks = blocks.size();
+    std::vector<BasicBlock *> postorder;
+    std::map<BasicBlock *, int> number;
 
-    std::set<BasicBlock *> allBlocks;
+    // iterative depth first search, recursion would overflow on long chains of blocks
+    std::vector<std::pair<BasicBlock *, size_t>> stack = {{getStartBlock(), 0}};
+    number[getStartBlock()] = -1;
 
-    for (auto& block : blocks)
-        allBlocks.insert(block.get());
+    while (!stack.empty()) {
+        auto &[block, next] = stack.back();
+        auto succs = block->getNextBlocks();
+
+        if (next < succs.size()) {
+            auto succ = succs[next++];
+
+            if (!number.contains(succ)) {
+                number[succ] = -1;
+                stack.push_back({succ, 0});
+            }
+        }
+        else {
+            number[block] = postorder.size();
+            postorder.push_back(block);
+            stack.pop_back();
+        }
+    }
 
-    // aside from start, set all block dominators to all other blocks
     for (auto &block : blocks) {
         block->immediateDominator = nullptr;
-        block->dominancefront.clear();
-        block->dominators.clear();
         block->domChildren.clear();
-        block->dominators = allBlocks;
     }
 
-    blocks[0]->dominators.clear();
-    blocks[0]->dominators.insert(blocks[0].get());
-        
-    // calculate dominators by iterating until fixed point reached
+    // dominators by postorder number, the start block is the highest and its own dominator while iterating
+    std::vector<int> idom(postorder.size(), -1);
+    int start = postorder.size() - 1;
+    idom[start] = start;
+
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (a < b)
+                a = idom[a];
+            while (b < a)
+                b = idom[b];
+        }
+
+        return a;
+    };
+
     bool changed = true;
     while (changed) {
         changed = false;
 
-        for (auto& block : blocks) {
-            std::vector<std::set<BasicBlock *>> predecessorDoms;
+        for (int i = start - 1; i >= 0; i--) {
+            int newIdom = -1;
 
-            for (auto& pred : block->predecessors)
-                predecessorDoms.push_back(pred->dominators);
+            for (auto pred : postorder[i]->predecessors) {
+                auto it = number.find(pred);
 
-            auto temp = compoundIntersection(predecessorDoms);
-            temp.insert(block.get());
+                // unreachable predecessors and ones not processed yet contribute nothing
+                if (it == number.end() || idom[it->second] == -1)
+                    continue;
 
-            if (temp != block->dominators) {
-                block->dominators = temp;
+                newIdom = newIdom == -1 ? it->second : intersect(it->second, newIdom);
+            }
+
+            if (newIdom != idom[i]) {
+                idom[i] = newIdom;
                 changed = true;
             }
         }
     }
 
-    // calculate immediate dominator and dominator children
-    for (auto& block : blocks) {
-        if (block.get() == blocks[0].get())
+    for (auto &block : blocks) {
+        auto it = number.find(block.get());
+        if (it == number.end() || it->second == start)
             continue;
 
-        for (auto dom : block->dominators) {
-            if (dom == block.get())
-                continue;
+        auto dom = postorder[idom[it->second]];
+        block->immediateDominator = dom;
+        dom->domChildren.push_back(block.get());
+    }
 
-            bool isIdom = true;
+    validAnalyses |= Dominators;
+}
 
-            // if current dominator dominates another dominator of current block, must not be dom parent
-            for (auto other : block->dominators) {
-                if (other == dom || other == block.get())
-                    continue;
+void MethodIR::computeDominanceFrontiers() {
+    requireAnalyses(Predecessors | Dominators);
 
-                if (other->dominators.contains(dom))
-                    isIdom = false;
-            }
+    for (auto &block : blocks)
+        block->dominancefront.clear();
 
-            // populate info if immediate dom found
-            if (isIdom) {
-                block->immediateDominator = dom;
-                dom->domChildren.insert(block.get());
-                break;
-            }
-        }
-    }
+    // a join is in the frontier of every block from each predecessor up to, but excluding, its immediate dominator
+    for (auto &block : blocks) {
+        if (block->predecessors.size() < 2)
+            continue;
 
-    // calculate dominance front
-    for (auto& block : blocks) {
         for (auto &pred : block->predecessors) {
+            // unreachable predecessors have no place in the tree
+            if (pred != getStartBlock() && !pred->immediateDominator)
+                continue;
+
             auto runner = pred;
 
-            while (runner != block->immediateDominator) {
+            while (runner && runner != block->immediateDominator) {
                 runner->dominancefront.insert(block.get());
                 runner = runner->immediateDominator;
             }
         }
     }
+
+    validAnalyses |= DominanceFrontiers;
 }
 
-void MethodIR::convertSSA() {
-    populateDominators();
+void MethodIR::convertSSA(bool pruned) {
+    auto stats = PassStats::active();
+
+    requireAnalyses(pruned ? DominanceFrontiers | Liveness : DominanceFrontiers);
 
     std::set<std::string> globals;
     std::map<std::string, std::set<BasicBlock *>> defBlocks;
@@ -155,10 +181,17 @@ void MethodIR::convertSSA() {
             worklist.pop_back();
 
             for (auto *domfrontBlock : b->dominancefront) {
+                // a variable that is dead on entry to the join needs no phi there
+                if (pruned && !domfrontBlock->liveIn.contains(global))
+                    continue;
+
                 if (!hasPhi.contains(domfrontBlock)) {
                     // insert a phi for the given variable
                     domfrontBlock->blockPhi.push_back(std::move(std::make_unique<Phi>(global)));
                     
+                    if (stats)
+                        stats->phis++;
+
                     hasPhi.insert(domfrontBlock);
                     
                     if (!defBlocks[global].contains(domfrontBlock))
@@ -178,6 +211,8 @@ void MethodIR::convertSSA() {
 
     // rename recursively down dominator tree from start block
     getStartBlock()->renameVars(counter, stack);
+
+    ssaVersions = std::move(counter);
 }
 
 void BasicBlock::renameVars(std::map<std::string,int> &counter, std::map<std::string,std::vector<int>> &stack) {
@@ -231,7 +266,7 @@ void BasicBlock::renameVars(std::map<std::string,int> &counter, std::map<std::st
             if (!stack[phi->outputVar].empty())
                 version = stack[phi->outputVar].back();
                 
-            phi->incoming.push_back({label, version});
+            phi->incoming.push_back({label, std::make_shared<Local>(phi->outputVar, version)});
         }
     }
 
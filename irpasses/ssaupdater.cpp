@@ -0,0 +1,159 @@
+// ssaupdater.cpp : places phis on demand for variables given new definitions
+#include "ssaupdater.h"
+
+#include <algorithm>
+#include <set>
+
+SSAUpdater::SSAUpdater(MethodIR &m, std::string variable): method(m), var(std::move(variable)) {
+    method.requireAnalyses(Predecessors);
+}
+
+void SSAUpdater::addDefinition(BasicBlock *block, ValPtr value) {
+    defined[block] = std::move(value);
+}
+
+ValPtr SSAUpdater::valueAtEnd(BasicBlock *block) {
+    auto it = defined.find(block);
+    return it != defined.end() ? it->second : valueAtStart(block);
+}
+
+ValPtr SSAUpdater::valueAtStart(BasicBlock *block) {
+    // follow single predecessor chains without recursing, they can be as long as the method
+    std::vector<BasicBlock *> chain;
+    std::set<BasicBlock *> onChain;
+    ValPtr value;
+
+    while (true) {
+        if (auto it = reaching.find(block); it != reaching.end()) {
+            value = it->second;
+            break;
+        }
+
+        chain.push_back(block);
+        onChain.insert(block);
+
+        // the start block sees version 0, as SSA construction leaves arguments and uninitialized reads
+        if (block->predecessors.empty()) {
+            value = std::make_shared<Local>(var, 0);
+            break;
+        }
+
+        if (block->predecessors.size() > 1) {
+            chain.pop_back();
+            value = placePhi(block);
+            break;
+        }
+
+        auto pred = *block->predecessors.begin();
+
+        if (auto it = defined.find(pred); it != defined.end()) {
+            value = it->second;
+            break;
+        }
+
+        // a loop of single predecessor blocks never reached from the start
+        if (onChain.contains(pred)) {
+            value = std::make_shared<Local>(var, 0);
+            break;
+        }
+
+        block = pred;
+    }
+
+    for (auto b : chain)
+        reaching[b] = value;
+
+    return value;
+}
+
+ValPtr SSAUpdater::placePhi(BasicBlock *block) {
+    auto phi = std::make_unique<Phi>(var);
+    phi->resultVersion = method.newVersion(var);
+
+    auto value = std::make_shared<Local>(var, phi->resultVersion);
+    auto raw = phi.get();
+
+    // registered before the arguments are looked up, so loops back to this block find the phi
+    reaching[block] = value;
+    block->blockPhi.push_back(std::move(phi));
+    placed.push_back({block, raw});
+    filling.insert(raw);
+    phiCount++;
+
+    // predecessors in block order, so placement does not depend on addresses
+    std::vector<BasicBlock *> preds(block->predecessors.begin(), block->predecessors.end());
+    std::sort(preds.begin(), preds.end(), [](BasicBlock *a, BasicBlock *b) { return a->label < b->label; });
+
+    for (auto pred : preds) {
+        auto arg = valueAtEnd(pred);
+        raw->incoming.push_back({pred->label, arg});
+    }
+
+    filling.erase(raw);
+
+    if (foldPhi(block, raw))
+        return reaching[block];
+
+    return value;
+}
+
+void SSAUpdater::replace(const ValPtr &from, const ValPtr &to) {
+    ValPtr old = from;
+    ValPtr with = to;
+
+    for (auto &[_, phi] : placed)
+        if (phi)
+            for (auto &[label, val] : phi->incoming)
+                if (sameValue(val, old))
+                    val = with;
+
+    for (auto &[_, val] : reaching)
+        if (sameValue(val, old))
+            val = with;
+
+    for (auto slot : rewritten)
+        if (sameValue(*slot, old))
+            *slot = with;
+}
+
+// a phi whose arguments are all one value or itself is replaced by that value, which can make
+// phis using it foldable in turn
+bool SSAUpdater::foldPhi(BasicBlock *block, Phi *phi) {
+    ValPtr self = std::make_shared<Local>(var, phi->resultVersion);
+    ValPtr same;
+
+    for (auto &[_, val] : phi->incoming) {
+        if (sameValue(val, self) || (same && sameValue(val, same)))
+            continue;
+
+        if (same)
+            return false;
+
+        same = val;
+    }
+
+    // only reachable from itself
+    if (!same)
+        same = std::make_shared<Local>(var, 0);
+
+    for (auto &entry : placed)
+        if (entry.second == phi)
+            entry.second = nullptr;
+
+    std::erase_if(block->blockPhi, [&](const std::unique_ptr<Phi> &p) { return p.get() == phi; });
+    phiCount--;
+
+    replace(self, same);
+
+    // phis still collecting arguments are folded once they have all of them
+    for (auto &[b, p] : placed)
+        if (p && !filling.contains(p) && std::any_of(p->incoming.begin(), p->incoming.end(), [&](auto &in) { return sameValue(in.second, same); }))
+            foldPhi(b, p);
+
+    return true;
+}
+
+void SSAUpdater::rewriteUse(ValPtr *slot, BasicBlock *block) {
+    *slot = valueAtStart(block);
+    rewritten.push_back(slot);
+}
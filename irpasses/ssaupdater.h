@@ -0,0 +1,52 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+// Restores SSA form for one variable after a transformation gave it new definitions or changed the CFG
+// Instead of recomputing dominance frontiers, the value reaching a use is found by walking predecessors
+// back to the definitions, placing a phi at each join on the way and folding phis that merge a single value
+// (Braun et al., "Simple and Efficient Construction of Static Single Assignment Form")
+// Def-use chains are not updated, callers drop them
+class SSAUpdater {
+    MethodIR &method;
+    std::string var;
+
+    // value of var at the end of each block that defines it
+    std::map<BasicBlock *, ValPtr> defined;
+
+    // value reaching the start of each block looked at so far
+    std::map<BasicBlock *, ValPtr> reaching;
+
+    // phis placed so far and the slots handed values, revisited when a phi is folded away
+    std::vector<std::pair<BasicBlock *, Phi *>> placed;
+    std::vector<ValPtr *> rewritten;
+
+    // phis whose arguments are still being looked up
+    std::set<Phi *> filling;
+
+    size_t phiCount = 0;
+
+    ValPtr placePhi(BasicBlock *block);
+    void replace(const ValPtr &from, const ValPtr &to);
+    bool foldPhi(BasicBlock *block, Phi *phi);
+
+public:
+    SSAUpdater(MethodIR &m, std::string variable);
+
+    void addDefinition(BasicBlock *block, ValPtr value);
+
+    ValPtr valueAtStart(BasicBlock *block);
+    ValPtr valueAtEnd(BasicBlock *block);
+
+    // point a use in block, before any definition of var in it, at the reaching value
+    // the slot must outlive the updater, it is rewritten again if the value's phi is folded away
+    void rewriteUse(ValPtr *slot, BasicBlock *block);
+
+    // phis placed and still in the method
+    size_t phisPlaced() const { return phiCount; }
+};
@@ -0,0 +1,259 @@
+// strength.cpp : replaces multiplications by constants with additions, and in loops with running sums
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+#include <bit>
+
+// ir441 gives no latencies, so a slow ALU op is taken to cost as much as a multiply does next to an add
+// on current hardware, and a phi as much as the copy it becomes out of SSA
+static const int fastCost = 1;
+static const int slowCost = 3;
+static const int phiCost = 1;
+
+// additions in the doubling chain for x * c, one per bit below the top and one more for every set bit among them
+static int chainCost(unsigned long c) {
+    if (c < 2)
+        return 0;
+
+    return (std::bit_width(c) - 1 + std::popcount(c) - 1) * fastCost;
+}
+
+// what a multiplication by c costs once reduced as far as it profitably goes
+static int mulCost(unsigned long c) {
+    return std::min(slowCost, chainCost(c));
+}
+
+// the variable operand of a multiplication by a constant, with the constant
+static std::pair<ValPtr, Const *> scaled(BinInst *bin) {
+    if (bin->op != Oper::Mul)
+        return {};
+
+    if (auto k = asConst(bin->rhs); k && !asConst(bin->lhs))
+        return {bin->lhs, k};
+
+    if (auto k = asConst(bin->lhs); k && !asConst(bin->rhs))
+        return {bin->rhs, k};
+
+    return {};
+}
+
+// dest + k or dest - k, whichever keeps the literal non-negative, as the interpreter cannot parse negative ones
+static std::unique_ptr<BinInst> addConstant(ValPtr dest, ValPtr v, unsigned long k) {
+    if ((long) k >= 0)
+        return std::make_unique<BinInst>(dest, Oper::Add, v, std::make_shared<Const>((long) k));
+
+    return std::make_unique<BinInst>(dest, Oper::Sub, v, std::make_shared<Const>((long) -k));
+}
+
+// instruction slot holding inst within its block
+static std::vector<std::unique_ptr<IROp>>::iterator position(BasicBlock *block, IROp *inst) {
+    return std::find_if(block->instructions.begin(), block->instructions.end(),
+        [&](const std::unique_ptr<IROp> &i) { return i.get() == inst; });
+}
+
+// A basic induction variable p stepping by s makes p * c a value stepping by s * c,
+// so a second phi can carry the product and the multiplication becomes one addition per iteration
+static size_t reduceInductions(MethodIR &method, DefUse &defUse) {
+    size_t reduced = 0;
+
+    for (auto loop : method.getLoops().all()) {
+        auto header = loop->header;
+
+        for (auto &iv : loop->inductions) {
+            if (!iv.isBasic())
+                continue;
+
+            auto phi = std::find_if(header->blockPhi.begin(), header->blockPhi.end(), [&](const std::unique_ptr<Phi> &phi) {
+                return sameValue(std::make_shared<Local>(phi->outputVar, phi->resultVersion), iv.value);
+            })->get();
+
+            auto p = iv.value;
+            auto pInfo = defUse.find(p);
+            auto stepInfo = defUse.find(iv.next);
+            auto step = stepInfo ? dynamic_cast<BinInst *>(stepInfo->def) : nullptr;
+
+            if (!pInfo || !step)
+                continue;
+
+            auto stepBlock = stepInfo->defBlock;
+            unsigned long s = iv.step;
+
+            // multiplications of p by each constant, and how many of them run on every iteration
+            std::map<long, std::vector<BinInst *>> products;
+            std::map<long, int> inLoop;
+            std::map<BinInst *, BasicBlock *> blockOf;
+
+            pInfo->forEachUse([&](DefUse::Use &use) {
+                auto bin = dynamic_cast<BinInst *>(use.user);
+                auto [v, k] = bin ? scaled(bin) : std::pair<ValPtr, Const *>{};
+
+                if (!k)
+                    return;
+
+                products[k->value].push_back(bin);
+                blockOf[bin] = use.block;
+                inLoop[k->value] += loop->contains(use.block);
+            });
+
+            for (auto &[c, muls] : products) {
+                if (muls.empty() || inLoop[c] * mulCost(c) <= fastCost + phiCost)
+                    continue;
+
+                auto name = method.newTemp()->name;
+                auto sum = std::make_unique<Phi>(name);
+                sum->resultVersion = method.newVersion(name);
+
+                ValPtr q = std::make_shared<Local>(name, sum->resultVersion);
+                ValPtr next = std::make_shared<Local>(name, method.newVersion(name));
+
+                // q + s * c lands next to p + s, wherever that is it reaches the end of every back edge
+                auto at = position(stepBlock, step);
+                stepBlock->instructions.insert(std::next(at), addConstant(next, q, s * (unsigned long) c));
+
+                for (auto &[label, val] : phi->incoming) {
+                    if (sameValue(val, step->dest)) {
+                        sum->incoming.push_back({label, next});
+                        continue;
+                    }
+
+                    // entry values scale once on the way in, folded when they are constant
+                    auto pred = *std::find_if(header->predecessors.begin(), header->predecessors.end(),
+                        [&](BasicBlock *b) { return b->label == label; });
+
+                    if (auto a = asConst(val); a && (long) ((unsigned long) a->value * c) >= 0) {
+                        sum->incoming.push_back({label, std::make_shared<Const>((long) ((unsigned long) a->value * c))});
+                        continue;
+                    }
+
+                    auto start = method.newTemp();
+                    pred->instructions.push_back(std::make_unique<BinInst>(start, Oper::Mul, val, std::make_shared<Const>(c)));
+                    sum->incoming.push_back({label, start});
+                }
+
+                header->blockPhi.push_back(std::move(sum));
+
+                for (auto mul : muls) {
+                    auto block = blockOf[mul];
+
+                    defUse.replaceAllUsesWith(valueKey(*asLocal(mul->dest)), q);
+                    defUse.erase(mul);
+                    block->instructions.erase(position(block, mul));
+                    reduced++;
+                }
+            }
+        }
+    }
+
+    return reduced;
+}
+
+// x * 0, x * 1 and x / 1 need no instruction
+static size_t removeIdentities(MethodIR &method, DefUse &defUse) {
+    size_t reduced = 0;
+
+    for (auto &block : method.blocks) {
+        std::erase_if(block->instructions, [&](const std::unique_ptr<IROp> &inst) {
+            auto bin = dynamic_cast<BinInst *>(inst.get());
+            auto dest = bin ? asLocal(bin->dest) : nullptr;
+
+            if (!dest)
+                return false;
+
+            ValPtr same;
+
+            if (bin->op == Oper::Div) {
+                auto k = asConst(bin->rhs);
+
+                if (!k || k->value != 1 || !asLocal(bin->lhs))
+                    return false;
+
+                same = bin->lhs;
+            }
+            else {
+                auto [x, k] = scaled(bin);
+
+                if (!k || k->value >= 2 || k->value < 0)
+                    return false;
+
+                same = k->value ? x : ValPtr(std::make_shared<Const>(0));
+            }
+
+            defUse.replaceAllUsesWith(valueKey(*dest), same);
+            defUse.erase(bin);
+            reduced++;
+            return true;
+        });
+    }
+
+    return reduced;
+}
+
+// x * c becomes a doubling chain of additions where that is cheaper
+// the chains are not in the def-use chains, so identities are removed before any operand is copied into one
+static size_t reduceProducts(MethodIR &method, DefUse &defUse) {
+    size_t reduced = 0;
+
+    for (auto &block : method.blocks) {
+        for (size_t i = 0; i < block->instructions.size(); i++) {
+            auto bin = dynamic_cast<BinInst *>(block->instructions[i].get());
+            auto dest = bin ? asLocal(bin->dest) : nullptr;
+
+            if (!dest)
+                continue;
+
+            auto [x, k] = scaled(bin);
+            unsigned long c = k ? k->value : 0;
+
+            if (!k || c < 2 || chainCost(c) >= slowCost)
+                continue;
+
+            // most significant bit first: double the sum so far, and add x for every set bit
+            std::vector<std::unique_ptr<IROp>> chain;
+            ValPtr sum = x;
+
+            for (int bit = std::bit_width(c) - 2; bit >= 0; bit--) {
+                bool last = bit == 0;
+                bool add = c >> bit & 1;
+
+                ValPtr twice = last && !add ? bin->dest : method.newTemp();
+                chain.push_back(std::make_unique<BinInst>(twice, Oper::Add, sum, sum));
+                sum = twice;
+
+                if (add) {
+                    ValPtr plus = last ? bin->dest : method.newTemp();
+                    chain.push_back(std::make_unique<BinInst>(plus, Oper::Add, sum, x));
+                    sum = plus;
+                }
+            }
+
+            // the chain ends in the same value, so uses stay as they are
+            defUse.erase(bin);
+            block->instructions.erase(block->instructions.begin() + i);
+
+            size_t n = chain.size();
+            block->instructions.insert(block->instructions.begin() + i, std::make_move_iterator(chain.begin()),
+                std::make_move_iterator(chain.end()));
+
+            i += n - 1;
+            reduced++;
+        }
+    }
+
+    return reduced;
+}
+
+void MethodIR::reduceStrength() {
+    requireAnalyses(Predecessors | Dominators | DefUses | Loops);
+
+    // multiplications a running sum replaces are gone before the cheaper ones are turned into additions
+    size_t reduced = reduceInductions(*this, defUse);
+    reduced += removeIdentities(*this, defUse);
+    reduced += reduceProducts(*this, defUse);
+
+    // new instructions are missing from the def-use chains
+    keepAnalyses(Predecessors | Dominators);
+
+    if (auto stats = PassStats::active())
+        stats->strengthReduced += reduced;
+}
@@ -0,0 +1,354 @@
+// unroll.cpp : copies the bodies of counted loops, every iteration when the count is small and a few per trip otherwise
+#include "ir.h"
+#include "passstats.h"
+
+#include <algorithm>
+
+// how a loop is rewritten: copies of its body run one after another, the last ones still looping if loopFrom is set
+struct UnrollPlan {
+    Loop *loop;
+    BasicBlock *preheader;
+    BasicBlock *latch;
+    BasicBlock *exit;
+
+    size_t copies = 0;
+    std::optional<size_t> loopFrom = std::nullopt;
+};
+
+// one copy of the loop body, with what every value the loop defines is called in it
+struct BodyCopy {
+    std::unordered_map<const BasicBlock *, BasicBlock *> block;
+    std::unordered_map<std::string, ValPtr> value;
+
+    ValPtr lookup(const ValPtr &v) const {
+        auto lcl = asLocal(v);
+        auto it = lcl ? value.find(valueKey(*lcl)) : value.end();
+        return it == value.end() ? v : it->second;
+    }
+};
+
+// rotated loops with a constant count, entered from one block and left from the test at the end of their only latch
+static std::optional<UnrollPlan> planUnroll(Loop *loop, size_t budget, size_t factor) {
+    if (!loop->tripCount || !loop->tripCount->constant)
+        return std::nullopt;
+
+    if (loop->latches.size() != 1 || loop->exiting.size() != 1 || loop->latches[0] != loop->exiting[0])
+        return std::nullopt;
+
+    std::vector<BasicBlock *> entries;
+    for (auto pred : loop->header->predecessors)
+        if (!loop->contains(pred))
+            entries.push_back(pred);
+
+    if (entries.size() != 1)
+        return std::nullopt;
+
+    auto latch = loop->latches[0];
+    auto cond = static_cast<Conditional *>(latch->blockTransfer.get());
+
+    UnrollPlan plan{loop, entries[0], latch, loop->contains(cond->trueTarget) ? cond->falseTarget : cond->trueTarget};
+
+    size_t size = loop->size;
+    size_t trips = *loop->tripCount->constant;
+
+    // counts past the budget are compared by dividing it, '!=' loops that wrap around count close to 2^64 trips
+    if (trips - 1 <= budget / size) {
+        plan.copies = trips;
+        return plan;
+    }
+
+    // the leftover trips run first, so only the test ending the last copy of each group can leave
+    if (factor < 2 || trips <= factor || factor - 1 + trips % factor > budget / size)
+        return std::nullopt;
+
+    plan.copies = trips % factor + factor;
+    plan.loopFrom = trips % factor;
+    return plan;
+}
+
+// blocks walked down the dominator tree inside the loop, so values are defined before the copies read them
+static std::vector<BasicBlock *> dominatorOrder(const Loop &loop) {
+    std::vector<BasicBlock *> order;
+    std::vector<BasicBlock *> work = {loop.header};
+
+    while (!work.empty()) {
+        auto block = work.back();
+        work.pop_back();
+        order.push_back(block);
+
+        for (auto child : block->domChildren)
+            if (loop.contains(child))
+                work.push_back(child);
+    }
+
+    return order;
+}
+
+// returns the header of the loop left behind when the copies still loop
+static BasicBlock *unroll(MethodIR &method, const UnrollPlan &plan) {
+    auto &loop = *plan.loop;
+    auto header = loop.header;
+    auto n = plan.copies;
+
+    auto incomingFrom = [](Phi *phi, BasicBlock *pred) {
+        auto it = std::find_if(phi->incoming.begin(), phi->incoming.end(), [&](auto &in) { return in.first == pred->label; });
+        return it->second;
+    };
+
+    std::vector<BodyCopy> copies(n);
+    std::vector<std::unique_ptr<Phi>> loopPhis;
+    std::vector<std::pair<BasicBlock *, BasicBlock *>> dropped;
+
+    auto order = dominatorOrder(loop);
+
+    for (auto &copy : copies)
+        for (auto block : loop.blocks)
+            copy.block[block] = method.newBasicBlock();
+
+    for (size_t i = 0; i < n; i++) {
+        auto &copy = copies[i];
+
+        // the header's values come from the copy before, or from outside for the first,
+        // except where the copies loop, which merges the two ways in
+        for (auto &phi : header->blockPhi) {
+            auto key = valueKey(Local(phi->outputVar, phi->resultVersion));
+
+            if (i == plan.loopFrom) {
+                auto merge = std::make_unique<Phi>(phi->outputVar);
+                merge->resultVersion = method.newVersion(phi->outputVar);
+                copy.value[key] = std::make_shared<Local>(phi->outputVar, merge->resultVersion);
+                loopPhis.push_back(std::move(merge));
+            }
+            else if (i == 0)
+                copy.value[key] = incomingFrom(phi.get(), plan.preheader);
+            else
+                copy.value[key] = copies[i - 1].lookup(incomingFrom(phi.get(), plan.latch));
+        }
+
+        for (auto block : loop.blocks) {
+            if (block != header)
+                for (auto &phi : block->blockPhi)
+                    copy.value[valueKey(Local(phi->outputVar, phi->resultVersion))] =
+                        std::make_shared<Local>(phi->outputVar, method.newVersion(phi->outputVar));
+
+            // variables become temporaries, which reuse-temps can give one name again so each copy's
+            // objects stop being reachable from a variable once the copy is done with them
+            for (auto &inst : block->instructions)
+                if (auto res = inst->result(); res && asLocal(*res))
+                    copy.value[valueKey(*asLocal(*res))] = method.newTemp();
+        }
+
+        // copies and arithmetic on constants fold away, which is most of what counted loops compute
+        for (auto block : order) {
+            auto target = copy.block[block];
+
+            for (auto &inst : block->instructions) {
+                auto clone = inst->clone();
+
+                for (auto slot : clone->operands())
+                    *slot = copy.lookup(*slot);
+
+                auto res = clone->result();
+                auto key = res && asLocal(*res) ? valueKey(*asLocal(*res)) : "";
+
+                if (auto asn = dynamic_cast<Assign *>(clone.get()); asn && !key.empty()) {
+                    copy.value[key] = asn->src;
+                    continue;
+                }
+
+                if (auto bin = dynamic_cast<BinInst *>(clone.get()); bin && !key.empty()) {
+                    auto l = asConst(bin->lhs);
+                    auto r = asConst(bin->rhs);
+                    auto folded = l && r ? foldBinary(bin->op, l->value, r->value) : std::nullopt;
+
+                    if (folded && *folded >= 0) {
+                        copy.value[key] = std::make_shared<Const>(*folded);
+                        continue;
+                    }
+                }
+
+                if (res)
+                    *res = copy.value.at(key);
+
+                target->instructions.push_back(std::move(clone));
+            }
+
+            if (block == plan.latch) {
+                auto cond = static_cast<Conditional *>(block->blockTransfer.get());
+                bool stayOnTrue = loop.contains(cond->trueTarget);
+
+                if (i + 1 < n)
+                    target->blockTransfer = std::make_unique<Jump>(copies[i + 1].block[header]);
+                else if (!plan.loopFrom)
+                    target->blockTransfer = std::make_unique<Jump>(plan.exit);
+                else {
+                    auto back = copies[*plan.loopFrom].block[header];
+                    target->blockTransfer = std::make_unique<Conditional>(copy.lookup(cond->condition),
+                        stayOnTrue ? back : plan.exit, stayOnTrue ? plan.exit : back);
+                }
+
+                continue;
+            }
+
+            auto transfer = block->blockTransfer->clone();
+
+            for (auto slot : transfer->operands())
+                *slot = copy.lookup(*slot);
+
+            for (auto succ : block->getNextBlocks())
+                transfer->replaceSuccessor(succ, copy.block.at(succ));
+
+            if (auto cond = dynamic_cast<Conditional *>(transfer.get()); cond && asConst(cond->condition)) {
+                bool taken = asConst(cond->condition)->value != 0;
+                dropped.push_back({target, taken ? cond->falseTarget : cond->trueTarget});
+                transfer = std::make_unique<Jump>(taken ? cond->trueTarget : cond->falseTarget);
+            }
+
+            target->blockTransfer = std::move(transfer);
+        }
+    }
+
+    // phis joining paths inside the body, read once every copy's values are known
+    for (auto &copy : copies)
+        for (auto block : loop.blocks) {
+            if (block == header)
+                continue;
+
+            for (auto &phi : block->blockPhi) {
+                auto join = copy.block[block];
+                auto clone = std::make_unique<Phi>(phi->outputVar);
+                clone->resultVersion = asLocal(copy.value.at(valueKey(Local(phi->outputVar, phi->resultVersion))))->version;
+
+                for (auto &[label, val] : phi->incoming) {
+                    auto pred = *std::find_if(loop.blocks.begin(), loop.blocks.end(), [&](BasicBlock *b) { return b->label == label; });
+                    auto from = copy.block[pred];
+
+                    if (std::find(dropped.begin(), dropped.end(), std::make_pair(from, join)) == dropped.end())
+                        clone->incoming.push_back({from->label, copy.lookup(val)});
+                }
+
+                join->blockPhi.push_back(std::move(clone));
+            }
+        }
+
+    if (plan.loopFrom) {
+        auto r = *plan.loopFrom;
+        auto enter = r == 0 ? plan.preheader : copies[r - 1].block[plan.latch];
+
+        for (size_t i = 0; i < header->blockPhi.size(); i++) {
+            auto &phi = header->blockPhi[i];
+            auto &merge = loopPhis[i];
+
+            merge->incoming.push_back({enter->label, r == 0 ? incomingFrom(phi.get(), plan.preheader) :
+                copies[r - 1].lookup(incomingFrom(phi.get(), plan.latch))});
+            merge->incoming.push_back({copies[n - 1].block[plan.latch]->label, copies[n - 1].lookup(incomingFrom(phi.get(), plan.latch))});
+
+            copies[r].block[header]->blockPhi.push_back(std::move(merge));
+        }
+    }
+
+    plan.preheader->blockTransfer->replaceSuccessor(header, copies[0].block[header]);
+
+    // everything after the loop sees the values of the last copy, the only one that leaves
+    auto &last = copies[n - 1];
+    auto lastLatch = last.block[plan.latch];
+
+    auto outside = [&](ValPtr *slot) {
+        auto lcl = asLocal(*slot);
+        if (lcl && loop.definitions.contains(valueKey(*lcl)))
+            *slot = last.lookup(*slot);
+    };
+
+    std::set<BasicBlock *> original(loop.blocks.begin(), loop.blocks.end());
+    std::set<BasicBlock *> added;
+
+    for (auto &copy : copies)
+        for (auto &[_, block] : copy.block)
+            added.insert(block);
+
+    for (auto &block : method.blocks) {
+        if (original.contains(block.get()) || added.contains(block.get()))
+            continue;
+
+        for (auto &phi : block->blockPhi) {
+            for (auto &[label, val] : phi->incoming) {
+                if (label == plan.latch->label)
+                    label = lastLatch->label;
+
+                outside(&val);
+            }
+        }
+
+        for (auto &inst : block->instructions)
+            for (auto slot : inst->operands())
+                outside(slot);
+
+        for (auto slot : block->blockTransfer->operands())
+            outside(slot);
+    }
+
+    // the copies take the place of the original blocks, in order
+    std::vector<std::unique_ptr<BasicBlock>> replacement;
+
+    for (auto &copy : copies)
+        for (auto block : loop.blocks)
+            replacement.emplace_back(copy.block[block]);
+
+    std::erase_if(method.blocks, [&](std::unique_ptr<BasicBlock> &b) {
+        if (added.contains(b.get())) {
+            b.release();
+            return true;
+        }
+
+        return false;
+    });
+
+    auto at = std::find_if(method.blocks.begin(), method.blocks.end(), [&](auto &b) { return b.get() == header; });
+    method.blocks.insert(at, std::make_move_iterator(replacement.begin()), std::make_move_iterator(replacement.end()));
+
+    std::erase_if(method.blocks, [&](const std::unique_ptr<BasicBlock> &b) { return original.contains(b.get()); });
+
+    // copies whose tests folded leave behind what only the way not taken led to, phis included
+    auto unreachable = method.removeUnreachableBlocks();
+
+    auto left = plan.loopFrom ? copies[*plan.loopFrom].block[header] : nullptr;
+    bool kept = std::none_of(unreachable.begin(), unreachable.end(), [&](auto &b) { return b.get() == left; });
+    return kept ? left : nullptr;
+}
+
+void MethodIR::unrollLoops(size_t budget, size_t factor) {
+    size_t unrolled = 0;
+
+    // loops already unrolled by the factor, or that could not be, by header label as blocks come and go
+    std::set<std::string> done;
+
+    while (true) {
+        requireAnalyses(Predecessors | Dominators | Loops);
+
+        std::optional<UnrollPlan> plan;
+        auto &all = loops.all();
+
+        // inner loops first, an outer loop is only looked at once the loops inside it are gone
+        for (auto it = all.rbegin(); it != all.rend() && !plan; it++) {
+            if (!(*it)->children.empty() || done.contains((*it)->header->label))
+                continue;
+
+            plan = planUnroll(*it, budget, factor);
+
+            if (!plan)
+                done.insert((*it)->header->label);
+        }
+
+        if (!plan)
+            break;
+
+        if (auto left = unroll(*this, *plan))
+            done.insert(left->label);
+
+        unrolled++;
+        keepAnalyses(0);
+    }
+
+    if (auto stats = PassStats::active())
+        stats->loopsUnrolled += unrolled;
+}
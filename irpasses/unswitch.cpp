@@ -0,0 +1,292 @@
+// unswitch.cpp : moves branches on values a loop never changes in front of it, with a copy of the loop for each way
+#include "ir.h"
+#include "passstats.h"
+#include "ssaupdater.h"
+
+#include <algorithm>
+
+// Adds the instructions computing v inside the loop to chain, operands first, and fails if any of them
+// depends on the loop or could fault once moved to where the loop might not have run it
+static bool invariantChain(const ValPtr &v, const Loop &loop, std::vector<std::pair<IROp *, BasicBlock *>> &chain) {
+    auto &defs = loop.definitions;
+    auto lcl = asLocal(v);
+    auto it = lcl ? defs.find(valueKey(*lcl)) : defs.end();
+
+    if (it == defs.end())
+        return true;
+
+    auto bin = dynamic_cast<BinInst *>(it->second.first);
+    if (!bin)
+        return false;
+
+    auto divisor = asConst(bin->rhs);
+    if (bin->op == Oper::Div && (!divisor || divisor->value == 0))
+        return false;
+
+    if (std::any_of(chain.begin(), chain.end(), [&](auto &link) { return link.first == bin; }))
+        return true;
+
+    if (!invariantChain(bin->lhs, loop, chain) || !invariantChain(bin->rhs, loop, chain))
+        return false;
+
+    chain.push_back(it->second);
+    return true;
+}
+
+// a branch in the loop, and what computes its test
+struct Candidate {
+    Loop *loop;
+    BasicBlock *branch;
+    std::vector<std::pair<IROp *, BasicBlock *>> chain = {};
+};
+
+static std::optional<Candidate> findCandidate(Loop &loop) {
+    for (auto block : loop.blocks) {
+        auto cond = dynamic_cast<Conditional *>(block->blockTransfer.get());
+
+        // constant tests are left to the passes folding branches
+        if (!cond || cond->trueTarget == cond->falseTarget || !asLocal(cond->condition))
+            continue;
+
+        Candidate found{&loop, block};
+        if (invariantChain(cond->condition, loop, found.chain))
+            return found;
+    }
+
+    return std::nullopt;
+}
+
+static void unswitch(MethodIR &method, const Candidate &plan, BasicBlock *preheader) {
+    auto &loop = *plan.loop;
+    auto header = loop.header;
+
+    // the test is computed in front of the loop, which also takes what it is computed from out of the loop
+    for (auto [inst, block] : plan.chain) {
+        auto at = std::find_if(block->instructions.begin(), block->instructions.end(),
+            [&](const std::unique_ptr<IROp> &i) { return i.get() == inst; });
+
+        preheader->instructions.push_back(std::move(*at));
+        block->instructions.erase(at);
+    }
+
+    ValPtr test = static_cast<Conditional *>(plan.branch->blockTransfer.get())->condition;
+
+    std::unordered_map<const BasicBlock *, BasicBlock *> copyOf;
+    std::map<std::string, BasicBlock *> inLoop;
+
+    for (auto block : loop.blocks) {
+        copyOf[block] = method.newBasicBlock();
+        inLoop[block->label] = block;
+    }
+
+    // every value the loop defines gets a new name in the copy
+    std::vector<std::pair<ValPtr, BasicBlock *>> defined;
+    std::unordered_map<std::string, ValPtr> renamed;
+
+    auto rename = [&](const ValPtr &v, BasicBlock *block) {
+        auto lcl = asLocal(v);
+        defined.push_back({v, block});
+        renamed[valueKey(*lcl)] = lcl->ignoreSSA ? ValPtr(method.newTemp()) : std::make_shared<Local>(lcl->name, method.newVersion(lcl->name));
+    };
+
+    for (auto block : loop.blocks) {
+        for (auto &phi : block->blockPhi)
+            rename(std::make_shared<Local>(phi->outputVar, phi->resultVersion), block);
+
+        for (auto &inst : block->instructions)
+            if (auto res = inst->result(); res && asLocal(*res))
+                rename(*res, block);
+    }
+
+    auto map = [&](const ValPtr &v) {
+        auto lcl = asLocal(v);
+        auto it = lcl ? renamed.find(valueKey(*lcl)) : renamed.end();
+        return it == renamed.end() ? v : it->second;
+    };
+
+    for (auto block : loop.blocks) {
+        auto copy = copyOf[block];
+
+        for (auto &phi : block->blockPhi) {
+            auto clone = std::make_unique<Phi>(phi->outputVar);
+            clone->resultVersion = asLocal(map(std::make_shared<Local>(phi->outputVar, phi->resultVersion)))->version;
+
+            for (auto &[label, val] : phi->incoming) {
+                auto it = inLoop.find(label);
+                clone->incoming.push_back({it == inLoop.end() ? label : copyOf[it->second]->label, map(val)});
+            }
+
+            copy->blockPhi.push_back(std::move(clone));
+        }
+
+        for (auto &inst : block->instructions) {
+            auto clone = inst->clone();
+
+            for (auto slot : clone->operands())
+                *slot = map(*slot);
+
+            if (auto res = clone->result())
+                *res = map(*res);
+
+            copy->instructions.push_back(std::move(clone));
+        }
+
+        auto transfer = block->blockTransfer->clone();
+
+        for (auto slot : transfer->operands())
+            *slot = map(*slot);
+
+        for (auto succ : block->getNextBlocks())
+            if (loop.contains(succ))
+                transfer->replaceSuccessor(succ, copyOf[succ]);
+
+        copy->blockTransfer = std::move(transfer);
+    }
+
+    // blocks after the loop are reached from both copies, with the values each one computed
+    for (auto block : loop.blocks) {
+        auto succs = block->getNextBlocks();
+
+        for (auto succ : std::set<BasicBlock *>(succs.begin(), succs.end())) {
+            if (loop.contains(succ))
+                continue;
+
+            for (auto &phi : succ->blockPhi)
+                for (size_t i = 0, n = phi->incoming.size(); i < n; i++)
+                    if (phi->incoming[i].first == block->label)
+                        phi->incoming.push_back({copyOf[block]->label, map(phi->incoming[i].second)});
+        }
+    }
+
+    // the original keeps the way the test takes when it holds, the copy the other
+    auto decide = [](BasicBlock *from, bool holds) {
+        auto cond = static_cast<Conditional *>(from->blockTransfer.get());
+        auto taken = holds ? cond->trueTarget : cond->falseTarget;
+        auto skipped = holds ? cond->falseTarget : cond->trueTarget;
+
+        for (auto &phi : skipped->blockPhi)
+            std::erase_if(phi->incoming, [&](auto &in) { return in.first == from->label; });
+
+        from->blockTransfer = std::make_unique<Jump>(taken);
+    };
+
+    decide(plan.branch, true);
+    decide(copyOf[plan.branch], false);
+
+    preheader->blockTransfer = std::make_unique<Conditional>(test, header, copyOf[header]);
+
+    // the copy goes right after the loop's last block
+    std::vector<std::unique_ptr<BasicBlock>> copies;
+    for (size_t i = method.blocks.size() - loop.blocks.size(); i < method.blocks.size(); i++)
+        copies.push_back(std::move(method.blocks[i]));
+
+    method.blocks.resize(method.blocks.size() - loop.blocks.size());
+
+    auto last = std::find_if(method.blocks.begin(), method.blocks.end(), [&](auto &b) { return b.get() == loop.blocks.back(); });
+    method.blocks.insert(std::next(last), std::make_move_iterator(copies.begin()), std::make_move_iterator(copies.end()));
+
+    // each copy leaves unreachable what only the way it no longer takes led to, dropped before values are looked up
+    auto dropped = method.removeUnreachableBlocks();
+    method.keepAnalyses(0);
+
+    auto live = [&](BasicBlock *block) {
+        return std::none_of(dropped.begin(), dropped.end(), [&](auto &b) { return b.get() == block; });
+    };
+
+    std::map<std::string, BasicBlock *> byLabel;
+    for (auto &b : method.blocks)
+        byLabel[b->label] = b.get();
+
+    std::set<BasicBlock *> copied;
+    for (auto &[_, copy] : copyOf)
+        copied.insert(copy);
+
+    auto inside = [&](BasicBlock *block) { return loop.contains(block) || copied.contains(block); };
+
+    // values used after the loop now come from either copy, the updater merges them where the two ways meet
+    for (auto &[original, block] : defined) {
+        std::vector<std::pair<ValPtr *, BasicBlock *>> uses;
+
+        for (auto &b : method.blocks) {
+            for (auto &phi : b->blockPhi)
+                for (auto &[label, val] : phi->incoming)
+                    if (sameValue(val, original) && !inside(byLabel.at(label)))
+                        uses.push_back({&val, byLabel.at(label)});
+
+            if (inside(b.get()))
+                continue;
+
+            for (auto &inst : b->instructions)
+                for (auto slot : inst->operands())
+                    if (sameValue(*slot, original))
+                        uses.push_back({slot, b.get()});
+
+            for (auto slot : b->blockTransfer->operands())
+                if (sameValue(*slot, original))
+                    uses.push_back({slot, b.get()});
+        }
+
+        if (uses.empty())
+            continue;
+
+        SSAUpdater updater(method, asLocal(original)->name);
+
+        if (live(block))
+            updater.addDefinition(block, original);
+
+        if (live(copyOf[block]))
+            updater.addDefinition(copyOf[block], map(original));
+
+        for (auto [slot, at] : uses)
+            updater.rewriteUse(slot, at);
+    }
+}
+
+void MethodIR::unswitchLoops(size_t budget) {
+    size_t unswitched = 0;
+
+    while (true) {
+        requireAnalyses(Predecessors | Dominators | Loops);
+
+        std::optional<Candidate> plan;
+        auto &all = loops.all();
+
+        // inner loops first, a test moved out of one may turn out invariant in the loop around it too
+        for (auto it = all.rbegin(); it != all.rend() && !plan; it++) {
+            auto preds = (*it)->header->predecessors;
+
+            // a loop only reached through its back edges has nowhere to put the test
+            if (std::all_of(preds.begin(), preds.end(), [&](BasicBlock *b) { return (*it)->contains(b); }))
+                continue;
+
+            if ((*it)->size > budget)
+                continue;
+
+            plan = findCandidate(**it);
+        }
+
+        if (!plan)
+            break;
+
+        auto header = plan->loop->header;
+        std::vector<BasicBlock *> entries;
+
+        for (auto pred : header->predecessors)
+            if (!plan->loop->contains(pred))
+                entries.push_back(pred);
+
+        // the test needs a block of its own that only leads into the loop, which takes one round to make
+        if (entries.size() != 1 || entries[0]->getNextBlocks().size() != 1) {
+            splitPredecessors(header, entries);
+            keepAnalyses(Predecessors | Dominators);
+            continue;
+        }
+
+        unswitch(*this, *plan, entries[0]);
+        budget -= plan->loop->size;
+        unswitched++;
+    }
+
+    if (auto stats = PassStats::active())
+        stats->loopsUnswitched += unswitched;
+}
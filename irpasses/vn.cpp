@@ -1,8 +1,11 @@
 #include "ir.h"
+#include "passstats.h"
 
 #include <map>
 #include <functional>
 #include <tuple>
+#include <optional>
+#include <vector>
 
 int Const::hash() const {
     return std::hash<std::string>()("<const|" + std::to_string(value) + ">");
@@ -21,75 +24,203 @@ int BinInst::hash(int lhsVN, int rhsVN) const {
         ("<" + std::to_string((int) op) + "|" + std::to_string(lhsVN) + "|" + std::to_string(rhsVN) + ">");
 }
 
-static std::tuple<int, bool> getVN(const ValPtr &v,
-                 std::map<int,int> &VN,
-                 std::map<int,ValPtr> &name,
-                 int &nextvn)
-{
-    int h = v->hash();
+// value numbers known at one point of a method
+// entries can be rolled back to a mark, so a dominator tree walk sees exactly the values of its dominators
+class ValueTable {
+    std::map<int,int> VN;
+    std::map<int,ValPtr> name;
+    int nextvn = 1;
 
-    // return value existing value number and false to indicate value is not new
-    if (VN.contains(h))
-        return std::make_tuple(VN[h], false);
+    // previous value number of every hash overwritten or added, and every name added, most recent last
+    std::vector<std::pair<int, std::optional<int>>> vnLog;
+    std::vector<int> nameLog;
 
-    // add hash to value number map and name map
-    int vn = nextvn++;
-    VN[h] = vn;
-    name[vn] = v;
+public:
+    using Mark = std::pair<size_t, size_t>;
 
-    // return new value and true to indicate value has just been added
-    return std::make_tuple(vn, true);
-}
+    Mark mark() const {
+        return {vnLog.size(), nameLog.size()};
+    }
 
-void BasicBlock::valueNumberingPass() {
-    std::map<int,int> VN;
-    std::map<int,ValPtr> name;
-   
-    int nextvn = 1;
+    void rollback(Mark m) {
+        while (vnLog.size() > m.first) {
+            auto [h, old] = vnLog.back();
+            vnLog.pop_back();
+
+            if (old)
+                VN[h] = *old;
+            else
+                VN.erase(h);
+        }
+
+        while (nameLog.size() > m.second) {
+            name.erase(nameLog.back());
+            nameLog.pop_back();
+        }
+    }
+
+    bool contains(int h) const {
+        return VN.contains(h);
+    }
+
+    int lookup(int h) const {
+        return VN.at(h);
+    }
+
+    void set(int h, int vn) {
+        auto it = VN.find(h);
+        vnLog.push_back({h, it == VN.end() ? std::nullopt : std::optional<int>(it->second)});
+        VN[h] = vn;
+    }
+
+    int fresh() {
+        return nextvn++;
+    }
+
+    const ValPtr &nameOf(int vn) {
+        return name[vn];
+    }
+
+    bool hasName(int vn) const {
+        return name.contains(vn);
+    }
+
+    void setName(int vn, ValPtr v) {
+        name[vn] = std::move(v);
+        nameLog.push_back(vn);
+    }
+
+    // value number of an operand, and whether it was seen for the first time
+    std::tuple<int, bool> getVN(const ValPtr &v) {
+        int h = v->hash();
+
+        // return value existing value number and false to indicate value is not new
+        if (VN.contains(h))
+            return std::make_tuple(VN[h], false);
+
+        // add hash to value number map and name map
+        int vn = fresh();
+        set(h, vn);
+        setName(vn, v);
+
+        // return new value and true to indicate value has just been added
+        return std::make_tuple(vn, true);
+    }
+};
+
+// with def-use chains a redundant result is replaced at its uses and the instruction deleted,
+// without them the instruction becomes a copy of the earlier value
+// addresses are only reused within the block and up to the next call or allocation, which may move what they
+// point into, so they never enter the table the dominator tree walk hands down
+static void numberBlock(BasicBlock &block, ValueTable &table, const std::set<std::string> &addresses, DefUse *defUse = nullptr) {
+    auto stats = PassStats::active();
+
+    auto replace = [&](std::unique_ptr<IROp> &instPtr, const ValPtr &dest, const ValPtr &subVal) {
+        if (stats)
+            stats->vnReplacements++;
+
+        if (!defUse) {
+            instPtr = std::make_unique<Assign>(dest, subVal);
+            return;
+        }
 
-    for (auto &instPtr : instructions) {
-        if (auto asn = dynamic_cast<Assign *>(instPtr.get())) {
-            auto [srcVN, newval] = getVN(asn->src, VN, name, nextvn);
+        defUse->replaceAllUsesWith(valueKey(dynamic_cast<Local &>(*dest)), subVal);
+        defUse->erase(instPtr.get());
+        instPtr.reset();
+    };
+
+    // value number of every address computed since the last call or allocation, by hash
+    std::map<int, int> recentAddresses;
+
+    for (auto &instPtr : block.instructions) {
+        if (dynamic_cast<Call *>(instPtr.get()) || dynamic_cast<Alloc *>(instPtr.get()))
+            recentAddresses.clear();
+        else if (auto asn = dynamic_cast<Assign *>(instPtr.get())) {
+            auto [srcVN, newval] = table.getVN(asn->src);
             
-            ValPtr subVal = name[srcVN];
+            ValPtr subVal = table.nameOf(srcVN);
             ValPtr dest = asn->dest;
         
-            if (!newval) {
-                instPtr = std::make_unique<Assign>(asn->dest, subVal);
-            }        
+            // every copy can go once uses can be rewritten, not only copies of values seen before
+            if (!newval || defUse)
+                replace(instPtr, dest, subVal);
 
-            VN[dest->hash()] = srcVN;
+            table.set(dest->hash(), srcVN);
         }
         else if (auto bin = dynamic_cast<BinInst *>(instPtr.get())) {
-            auto [lhsVN, newLHS] = getVN(bin->lhs, VN, name, nextvn);
-            auto [rhsVN, newRHS] = getVN(bin->rhs, VN, name, nextvn);
+            auto [lhsVN, newLHS] = table.getVN(bin->lhs);
+            auto [rhsVN, newRHS] = table.getVN(bin->rhs);
 
             int H = bin->hash(lhsVN, rhsVN);
 
             auto dest = bin->dest;
-
-            if (VN.contains(H)) {
-                int vn = VN[H];
-                ValPtr subVal = name[vn];
-                instPtr = std::make_unique<Assign>(bin->dest, subVal);
-                VN[dest->hash()] = vn;
+            auto lcl = dynamic_cast<Local *>(dest.get());
+
+            if (lcl && addresses.contains(valueKey(*lcl))) {
+                if (auto it = recentAddresses.find(H); it != recentAddresses.end()) {
+                    replace(instPtr, dest, table.nameOf(it->second));
+                    table.set(dest->hash(), it->second);
+                } else {
+                    int vn = table.fresh();
+                    table.setName(vn, dest);
+                    table.set(dest->hash(), vn);
+                    recentAddresses[H] = vn;
+                }
+            } else if (table.contains(H)) {
+                int vn = table.lookup(H);
+                ValPtr subVal = table.nameOf(vn);
+                replace(instPtr, dest, subVal);
+                table.set(dest->hash(), vn);
             } else {
-                int vn = nextvn++;
-                VN[H] = vn;
+                int vn = table.fresh();
+                table.set(H, vn);
                 
-                if (!name.contains(vn))
-                    name[vn] = bin->dest;
+                if (!table.hasName(vn))
+                    table.setName(vn, bin->dest);
 
-                VN[dest->hash()] = vn;
+                table.set(dest->hash(), vn);
             }
         }
     }
+
+    if (defUse)
+        std::erase(block.instructions, nullptr);
+}
+
+void BasicBlock::valueNumberingPass(const std::set<std::string> &addresses) {
+    ValueTable table;
+    numberBlock(*this, table, addresses);
+}
+
+// blocks see every value computed in their dominators, which SSA guarantees are still intact
+static void numberDominatorTree(BasicBlock &block, ValueTable &table, const std::set<std::string> &addresses, DefUse &defUse) {
+    auto mark = table.mark();
+
+    numberBlock(block, table, addresses, &defUse);
+
+    for (auto child : block.domChildren)
+        numberDominatorTree(*child, table, addresses, defUse);
+
+    table.rollback(mark);
+}
+
+void MethodIR::globalValueNumbering() {
+    requireAnalyses(Dominators | DefUses);
+
+    ValueTable table;
+    numberDominatorTree(*getStartBlock(), table, addressValues(), defUse);
+}
+
+void MethodIR::valueNumberingPass() {
+    auto addresses = addressValues();
+
+    for (auto &block : blocks) {
+        block->valueNumberingPass(addresses);
+    }
 }
 
 void CFG::valueNumberingPass() {
     for (auto &[name, method] : methodinfo) {
-        for (auto &block : method->blocks) {
-            block->valueNumberingPass();
-        }
+        method->valueNumberingPass();
     }
 }